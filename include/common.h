@@ -4,6 +4,7 @@
 /* Define structs and routine could be used by every source files */
 
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
 
 #ifndef OSCFG_H
@@ -41,20 +42,23 @@ typedef ARG_TYPE arg_t;
  *            based on the address mode
  */
 #ifdef MM64
-#define FORMAT_ARG "%llu"
+#define FORMAT_ARG "%" SCNu64
 #else
-#define FORMAT_ARG "%u"
+#define FORMAT_ARG "%" SCNu32
 #endif
 
 
 enum ins_opcode_t
 {
-	CALC,  // Just perform calculation, only use CPU
+	CALC,  // Just perform calculation, only use CPU (arg_0 fused CALC count)
 	ALLOC, // Allocate memory
 	FREE,  // Deallocated a memory block
 	READ,  // Write data to a byte on memory
 	WRITE, // Read data from a byte on memory
 	SYSCALL,
+	MEMSET, // Fill a range of a memory region with a byte value
+	MEMCPY, // Copy a range between two memory regions
+	MEMCMP, // Compare a range of two memory regions
 };
 
 /* instructions executed by the CPU */
@@ -69,8 +73,16 @@ struct inst_t
 
 struct code_seg_t
 {
-	struct inst_t *text;
-	uint32_t size;
+	uint8_t *text;	 // Compact encoded instructions (see inst.h)
+	uint32_t size;	 // Size of text in bytes
+#ifndef MM_CODE_PAGING
+	struct inst_t *insts; // Text decoded once by the loader, fetched by run()
+	uint8_t *len;	 // Encoded length of each instruction of insts
+#endif
+	uint32_t ref; // Number of PCBs sharing this segment (loader cache)
+#ifdef MM_CODE_PAGING
+	addr_t vbase;	 // Start of the text in the code VMA, 0 if not mapped
+#endif
 };
 
 struct trans_table_t
@@ -96,21 +108,36 @@ struct page_table_t
 	int size; // Number of row in the first layer
 };
 
-/* PCB, describe information about a process */
+/* Cold part of the PCB: only touched when the process is loaded or
+ * exits and by the memory management paths, kept out of the cache
+ * lines the scheduler and the interpreter walk */
+struct pcb_cold_t
+{
+	char path[100];
+	struct page_table_t *page_table; // Page table
+	uint32_t bp;			 // Break pointer
+	/* Memory regions of this process, indexed by region ID (MM_PAGING) */
+	struct vm_rg_struct symrgtbl[PAGING_MAX_SYMTBL_SZ];
+};
+
+/* PCB, describe information about a process.
+ * Hot part only: the scheduling fields and the execution state sit
+ * together in two cache lines (the loader aligns PCBs to 64 bytes).
+ */
 struct pcb_t
 {
 	uint32_t pid;		 // PID
 	uint32_t priority;	 // Default priority, this legacy process based (FIXED)
-	char path[100];
-	struct code_seg_t *code; // Code segment
-	addr_t regs[10];	 // Registers, store address of allocated regions
-	uint32_t pc;		 // Program pointer, point to the next instruction
 #ifdef MLQ_SCHED
 	uint32_t prio;
 #endif
+	uint32_t pc;		 // Program pointer, byte offset of the next instruction
+	uint32_t calc_done;	 // Units of the fused CALC at pc already executed
+	uint32_t ip;		 // Index of the instruction at pc
+	struct code_seg_t *code; // Code segment
 	struct krnl_t *krnl;
-	struct page_table_t *page_table; // Page table
-	uint32_t bp;			 // Break pointer
+	struct pcb_cold_t *cold; // Cold part (path, page table, regions)
+	addr_t regs[10];	 // Registers, store address of allocated regions
 };
 
 /* Kernel structure */
@@ -9,5 +9,11 @@
  * Otherwise, return 1. */
 int run(struct pcb_t * proc);
 
+/* Execute the instruction of a process for up to [budget] time
+ * slots. A fused CALC consumes as many slots as it has units left,
+ * any other instruction takes one slot. Return the slots used and
+ * store the run() status in [stat]. */
+uint32_t run_slots(struct pcb_t * proc, uint32_t budget, int * stat);
+
 #endif
 
@@ -0,0 +1,33 @@
+#ifndef INST_H
+#define INST_H
+
+#include "common.h"
+
+/*
+ * Compact instruction encoding of the code segment
+ *
+ *   byte 0   : bit 0-6 opcode, bit 7 INST_EXT_FLAG
+ *   operands : LEB128 varints (7 bits per byte, low group first)
+ *
+ * Each opcode carries a fixed number of operands (see inst_nargs).
+ * A plain CALC is a single byte, a fused CALC-N sets INST_EXT_FLAG
+ * and is followed by N as a varint.
+ */
+#define INST_OPCODE_MASK 0x7F
+#define INST_EXT_FLAG    0x80
+#define INST_OPCODE(b)   ((enum ins_opcode_t)((b) & INST_OPCODE_MASK))
+
+/* Longest encoding: opcode + 4 operands of a 64-bit varint */
+#define INST_MAX_LEN (1 + 4 * 10)
+
+/* Encode [ins] into [buf] (at least INST_MAX_LEN bytes), return its length */
+uint32_t inst_encode(uint8_t * buf, const struct inst_t * ins);
+
+/* Decode the instruction at [buf] into [ins], return its length */
+uint32_t inst_decode(const uint8_t * buf, struct inst_t * ins);
+
+/* Length of the instruction at [buf] if it is complete within the
+ * first [avail] bytes, 0 otherwise */
+uint32_t inst_length(const uint8_t * buf, uint32_t avail);
+
+#endif
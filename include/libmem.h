@@ -21,3 +21,9 @@ int liballoc(struct pcb_t *, addr_t, uint32_t);
 int libfree(struct pcb_t *, uint32_t);
 int libread(struct pcb_t*, uint32_t, addr_t, uint32_t*);
 int libwrite(struct pcb_t*, BYTE, uint32_t, addr_t);
+int libmemset(struct pcb_t*, uint32_t, addr_t, addr_t, BYTE);
+int libmemcpy(struct pcb_t*, uint32_t, uint32_t, addr_t);
+int libmemcmp(struct pcb_t*, uint32_t, uint32_t, addr_t);
+int libfetch(struct pcb_t*, uint32_t, uint8_t*, uint32_t);
+void libitlb_stats(uint64_t *hit, uint64_t *miss);
+void libswap_report(void);
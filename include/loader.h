@@ -5,5 +5,15 @@
 
 struct pcb_t * load(const char * path);
 
+/* Parse the program at [path] into a new PCB without giving it a PID.
+ * Used by the prefetch workers ahead of the process start time */
+struct pcb_t * load_image(const char * path);
+
+/* Give [proc] the next PID, in admission order */
+void assign_pid(struct pcb_t * proc);
+
+/* Release a finished process and drop its reference to the shared code */
+void unload(struct pcb_t * proc);
+
 #endif
 
@@ -14,6 +14,11 @@
 #define PAGING_MAX_PGN  (DIV_ROUND_UP(BIT(PAGING_CPU_BUS_WIDTH),PAGING_PAGESZ))
 
 #define PAGING_SBRK_INIT_SZ PAGING_PAGESZ
+
+/* Code VMA holding the program text, upper half of the address space */
+#define PAGING_CODE_VMAID 1
+#define PAGING_CODE_VMA_BASE BIT(PAGING_CPU_BUS_WIDTH - 1)
+#define PAGING_CODE_VMA_END BIT(PAGING_CPU_BUS_WIDTH)
 /* PTE BIT */
 #define PAGING_PTE_PRESENT_MASK BIT(31) 
 #define PAGING_PTE_SWAPPED_MASK BIT(30)
@@ -21,6 +26,9 @@
 #define PAGING_PTE_DIRTY_MASK BIT(28)
 #define PAGING_PTE_EMPTY01_MASK BIT(14)
 #define PAGING_PTE_EMPTY02_MASK BIT(13)
+/* On-line page mapped read-only on the shared zero frame, takes the
+ * reserved bit */
+#define PAGING_PTE_ZERO_MASK PAGING_PTE_RESERVE_MASK
 
 /* PTE BIT PRESENT */
 #define PAGING_PTE_SET_PRESENT(pte) (pte=pte|PAGING_PTE_PRESENT_MASK)
@@ -50,6 +58,10 @@
 #define PAGING_PTE_PGN(pte)   GETVAL(pte,PAGING_PGN_MASK,PAGING_ADDR_PGN_LOBIT)
 #define PAGING_PTE_FPN(pte)   GETVAL(pte,PAGING_PTE_FPN_MASK,PAGING_PTE_FPN_LOBIT)
 #define PAGING_PTE_SWP(pte)   GETVAL(pte,PAGING_PTE_SWPOFF_MASK,PAGING_SWPFPN_OFFSET)
+#define PAGING_PTE_SWPTYP(pte) GETVAL(pte,PAGING_PTE_SWPTYP_MASK,PAGING_PTE_SWPTYP_LOBIT)
+
+/* Swap type of a page held by the compressed swap tier (mm-zswap.c) */
+#define PAGING_SWPTYP_ZSWAP 0x1F
 
 /* OFFSET */
 #define PAGING_ADDR_OFFST_LOBIT 0
@@ -116,8 +128,10 @@ int get_pd_from_address(addr_t addr, addr_t* pgd, addr_t* p4d, addr_t* pud, addr
 int get_pd_from_pagenum(addr_t pgn, addr_t* pgd, addr_t* p4d, addr_t* pud, addr_t* pmd, addr_t* pt);
 int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn);
 int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff);
+int pte_set_zero(struct pcb_t *caller, addr_t pgn, addr_t fpn);
 uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn);
 int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val);
+int pte_clear(struct pcb_t *caller, addr_t pgn);
 int init_pte(addr_t *pte,
              int pre,    // present
              addr_t fpn,    // FPN
@@ -129,7 +143,12 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *allo
 int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE value);
+int __memset(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, addr_t size, BYTE value);
+int __memcpy(struct pcb_t *caller, int vmaid, int srcid, int dstid, addr_t size);
+int __memcmp(struct pcb_t *caller, int vmaid, int srcid, int dstid, addr_t size, int *result);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
+int free_pcb_memph(struct pcb_t *caller);
+int free_code_memph(struct pcb_t *caller, struct code_seg_t *code);
 
 /* VM prototypes */
 int pgalloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
@@ -145,7 +164,7 @@ int pgwrite(
 		uint32_t destination, // Index of destination register
 		addr_t offset);
 /* Local VM prototypes */
-struct vm_rg_struct * get_symrg_byid(struct mm_struct* mm, int rgid);
+struct vm_rg_struct * get_symrg_byid(struct pcb_t *caller, int rgid);
 int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, addr_t vmastart, addr_t vmaend);
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg);
 int inc_vma_limit(struct pcb_t *caller, int vmaid, addr_t inc_sz);
@@ -157,8 +176,49 @@ int MEMPHY_get_freefp(struct memphy_struct *mp, addr_t *fpn);
 int MEMPHY_put_freefp(struct memphy_struct *mp, addr_t fpn);
 int MEMPHY_read(struct memphy_struct * mp, addr_t addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, addr_t addr, BYTE data);
+int MEMPHY_read_block(struct memphy_struct *mp, addr_t addr, BYTE *buf, addr_t len);
+int MEMPHY_write_block(struct memphy_struct *mp, addr_t addr, const BYTE *buf, addr_t len);
+int MEMPHY_fill(struct memphy_struct *mp, addr_t addr, BYTE value, addr_t len);
+int MEMPHY_read_page(struct memphy_struct *mp, addr_t fpn, BYTE *buf);
+int MEMPHY_write_page(struct memphy_struct *mp, addr_t fpn, const BYTE *buf);
+int MEMPHY_copy_page(struct memphy_struct *mpsrc, addr_t srcfpn,
+                     struct memphy_struct *mpdst, addr_t dstfpn);
 int MEMPHY_dump(struct memphy_struct * mp);
+int MEMPHY_dump_file(struct memphy_struct *mp, const char *path);
+void MEMPHY_set_owner(struct memphy_struct *mp, addr_t fpn, uint32_t pid);
+uint32_t MEMPHY_get_owner(struct memphy_struct *mp, addr_t fpn);
+void MEMPHY_rmap_set(struct memphy_struct *mp, addr_t fpn,
+                     struct mm_struct *mm, addr_t pgn);
+int MEMPHY_rmap_get(struct memphy_struct *mp, addr_t fpn,
+                    struct mm_struct **mm, addr_t *pgn);
+int MEMPHY_buddy_init(struct memphy_struct *mp);
+int MEMPHY_alloc_order(struct memphy_struct *mp, int order, addr_t *fpn);
+int MEMPHY_free_order(struct memphy_struct *mp, addr_t fpn, int order);
+void MEMPHY_frag_report(struct memphy_struct *mp, const char *name);
+int MEMPHY_numa_init(struct memphy_struct *mp, int nodes);
+void MEMPHY_numa_report(struct memphy_struct *mp, const char *name);
+void MEMPHY_set_node(int node);
+addr_t MEMPHY_free_frames(struct memphy_struct *mp);
+int MEMPHY_zero_init(struct memphy_struct *mp);
+int MEMPHY_zero_frame(struct memphy_struct *mp, addr_t *fpn);
+int MEMPHY_page_is_zero(struct memphy_struct *mp, addr_t fpn);
 int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg);
+int init_memphy_file(struct memphy_struct *mp, addr_t max_size, int randomflg,
+                     const char *path);
+int MEMPHY_sync(struct memphy_struct *mp);
+uint32_t MEMPHY_take_stall(void);
+void MEMPHY_seq_stats(struct memphy_struct *mp, uint64_t *seek,
+                      uint64_t *xfer, double *busy);
+
+/* Compressed swap tier */
+#ifdef MM_ZSWAP
+int zswap_init(struct memphy_struct *mram, addr_t pool_sz);
+int zswap_store(const BYTE *page, addr_t *handle, const addr_t *spare);
+int zswap_load(addr_t handle, BYTE *page);
+int zswap_free(addr_t handle);
+void zswap_account_dev(int swapin);
+void zswap_report(void);
+#endif
 
 /* print list */
 int print_list_fp(struct framephy_struct *fp);
@@ -21,6 +21,96 @@
 #define IODUMP 1
 #define PAGETBL_DUMP 1
 
+/* Loader prefetch: number of worker threads parsing upcoming programs
+ * and maximum number of parsed-but-not-admitted processes kept ahead
+ */
+#define LD_PREFETCH_WORKERS 2
+#define LD_PREFETCH_WINDOW 8
+
+/* Frames cached per CPU and per MEMPHY device, moved to and from the
+ * global frame bitmap by halves
+ */
+#define MEMPHY_MAG_SIZE 32
+
+/* MEMRAM frames are managed by a buddy allocator so that vm_map_ram()
+ * gets physically contiguous runs of up to 2^MEMPHY_MAX_ORDER frames
+ */
+#define MEMPHY_BUDDY_RAM
+#define MEMPHY_MAX_ORDER 10
+
+/* NUMA MEMRAM: the RAM frames are split into MM_NUMA_NODES equal nodes
+ * and CPU i sits on node i % MM_NUMA_NODES. Frames are allocated on the
+ * local node first, then by increasing MM_NUMA_DISTANCE (node to node,
+ * 10 = local). Remote accesses stall the CPU per byte moved:
+ * MM_NUMA_REMOTE_COST milli-slots per KiB per 10 units of distance
+ * (same unit as MEMPHY_SEQ_XFER_COST). Needs MEMPHY_BUDDY_RAM.
+ */
+//#define MM_NUMA_NODES 2
+#define MM_NUMA_DISTANCE { { 10, 20 }, { 20, 10 } }
+#define MM_NUMA_REMOTE_COST 20
+
+/* Back the MEMSWP devices by sparse files mapped shared instead of heap
+ * memory; %d is the swap device index. The images stay on disk after
+ * the run for inspection.
+ */
+//#define MEMPHY_SWP_FILE "mswp%d.img"
+
+/* Sequential (tape like) MEMSWP devices: the head moves from its last
+ * position to the accessed address then streams the data. Costs are
+ * milli-slots per KiB of head travel and per KiB transferred, paid by
+ * the CPU doing the access.
+ */
+//#define MEMPHY_SWP_SEQ
+#define MEMPHY_SEQ_SEEK_COST 2
+#define MEMPHY_SEQ_XFER_COST 50
+
+/* Compressed swap tier: swapped out pages are kept LZ compressed, two
+ * per frame, in MEMRAM frames taken as the pool grows (at most
+ * ZSWAP_POOL_SZ bytes and ZSWAP_MAX_PCT percent of MEMRAM). A page
+ * reaches the MEMSWP device when no frame has room or it compresses to
+ * more than ZSWAP_MAX_COMP
+ */
+#define MM_ZSWAP
+#define ZSWAP_POOL_SZ 0x10000
+#define ZSWAP_MAX_PCT 25
+#define ZSWAP_MAX_COMP 192
+
+/* Swap slots are handed out from clusters of 2^MM_SWAP_CLUSTER_ORDER
+ * adjacent slots (MEMSWP devices run the buddy allocator), so that
+ * consecutive evictions are written next to each other
+ */
+#define MM_SWAP_CLUSTER_ORDER 3
+
+/* One MEMRAM frame is kept all zero and shared read-only: reading a
+ * page never written maps it instead of taking a frame, the first write
+ * gets a private copy. A page found all zero on swap-out goes back to
+ * it (PTE zero flag) instead of taking a swap slot.
+ */
+#define MM_ZERO_PAGE
+
+/* Memory dumps: runs of at least MEMPHY_DUMP_RLE_MIN equal bytes are
+ * printed once; with MEMPHY_DUMP_PATH the RAM dump is written there as
+ * a binary file instead of printed
+ */
+#define MEMPHY_DUMP_RLE_MIN 4
+//#define MEMPHY_DUMP_PATH "mram.dump"
+
+/* Number of PCB / code segment objects the loader carves per slab */
+#define LD_SLAB_OBJS 32
+
+/* Per opcode and per process execution profile: with PROF_REPORT the
+ * table is printed at exit and written as CSV to PROF_CSV_PATH
+ */
+//#define PROF_REPORT
+#define PROF_CSV_PATH "prof.csv"
+
+/* Instruction fetch through the simulated MMU: program text is mapped
+ * into the code VMA of the mm and run() reads it through a per-CPU
+ * i-TLB of ITLB_ENTRIES entries (direct mapped, power of 2)
+ */
+//#define MM_CODE_PAGING
+#define ITLB_ENTRIES 16
+
 /* 
  * @bksysnet:
  *    The address mode must be explicitly define in MM64 or no-MM64
@@ -12,10 +12,12 @@
 #define OSMM_H
 
 #include <stdint.h>
+#include <inttypes.h>
 
 #define MM_PAGING
 #define PAGING_MAX_MMSWP 4 /* max number of supported swapped space */
 #define PAGING_MAX_SYMTBL_SZ 30
+#define MEMPHY_MAP_LEVELS 5 /* 64^5 frames, 256GB of 256 byte pages */
 
 /* 
  * @bksysnet: in long address mode of 64bit or original 32bit
@@ -40,9 +42,11 @@ typedef ADDR_TYPE addr_t;
 #ifdef MM64
 #define FORMAT_ADDR "%lld"
 #define FORMATX_ADDR "%16llx"
+#define SCAN_ADDR "%" SCNu64
 #else
 #define FORMAT_ADDR "%d"
 #define FORMATX_ADDR "%08x"
+#define SCAN_ADDR "%" SCNu32
 #endif
 
 struct pgn_t{
@@ -94,11 +98,16 @@ struct mm_struct {
 
    struct vm_area_struct *mmap;
 
-   /* Currently we support a fixed number of symbol */
-   struct vm_rg_struct symrgtbl[PAGING_MAX_SYMTBL_SZ];
+   /* Number of live symbol regions on each page, indexed by PGN */
+   uint32_t *pgusr;
+   addr_t pgusr_sz;
 
    /* list of free page */
    struct pgn_t *fifo_pgn;
+
+   /* Bumped whenever a translation is removed (swap out, unmap),
+    * TLBs caching an older generation flush themselves */
+   uint32_t tlb_gen;
 };
 
 /*
@@ -112,18 +121,42 @@ struct framephy_struct {
    struct mm_struct* owner;
 };
 
+/* Reverse map entry: the page table entry mapping a frame (or holding
+ * a swap slot), mm == NULL when the frame is not mapped */
+struct memphy_rmap {
+   struct mm_struct *mm;
+   addr_t pgn;
+};
+
 struct memphy_struct {
    /* Basic field of data and size */
    BYTE *storage;
-   int maxsz;
+   addr_t maxsz;
+   int fd;        /* backing file of a mmap'ed device, -1 if in memory */
    
-   /* Sequential device fields */ 
+   /* Sequential device fields: head position, bytes of head travel and
+    * of transfer, busy time (see the cost model in mm-memphy.c) */
    int rdmflg;
-   int cursor;
-
-   /* Management structure */
-   struct framephy_struct *free_fp_list;
-   struct framephy_struct *used_fp_list;
+   addr_t cursor;
+   uint64_t seq_seek;
+   uint64_t seq_xfer;
+   uint64_t seq_busy;
+
+   /* Management structure: frame bitmap (bit set = frame in use) under
+    * summary levels, a bit of level k+1 is set when the matching word
+    * of level k is full. fp_map[0] is the frame bitmap, the top level
+    * is a single word.
+    */
+   uint64_t *fp_map[MEMPHY_MAP_LEVELS];
+   int fp_levels;
+   addr_t fp_num;
+   addr_t fp_free;       /* in the pool only, see MEMPHY_free_frames */
+   uint32_t *fp_owner;   /* PID a frame is mapped for, for dumps */
+   struct memphy_rmap *fp_rmap;
+
+   /* The bitmap is the global pool, CPUs allocate from their own frame
+    * magazine first (see mm-memphy.c) */
+   struct memphy_pool *pool;
 };
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include "common.h"
+
+/* Number of opcodes tracked by the profiler */
+#define PROF_NR_OPCODES (MEMCMP + 1)
+
+struct prof_cnt {
+	uint64_t count;	/* Executed instructions (CALC-N counts N) */
+	uint64_t ns;	/* Host time spent in run() */
+	uint64_t fail;	/* Instructions returning a non-zero status */
+};
+
+/* Allocate the per-CPU counters, must be called before the CPUs start */
+void prof_init(int num_cpus);
+
+/* Monotonic host clock in nanoseconds */
+uint64_t prof_clock(void);
+
+/* Account [units] instructions of [opcode] run by [pid] on CPU [cpu].
+ * Only the CPU thread [cpu] touches its counters, no locking needed */
+void prof_account(int cpu, uint32_t pid, int opcode, uint32_t units,
+		uint64_t ns, int fail);
+
+/* Record the i-TLB hits and misses of CPU [cpu] */
+void prof_itlb(int cpu, uint64_t hit, uint64_t miss);
+
+/* Merge the per-CPU counters and print the report table to stdout */
+void prof_report(void);
+
+/* Merge the per-CPU counters and write them as CSV to [path] */
+int prof_write_csv(const char * path);
+
+#endif
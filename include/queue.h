@@ -4,11 +4,13 @@
 
 #include "common.h"
 
+/* Initial capacity of a queue, it grows on demand */
 #define MAX_QUEUE_SIZE 50
 
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
+	struct pcb_t ** proc;
 	int size;
+	int cap;
 };
 
 void enqueue(struct queue_t * q, struct pcb_t * proc);
@@ -1,5 +1,5 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
 
@@ -23,6 +23,12 @@ void put_proc(struct pcb_t * proc);
 /* Add a new process to ready queue */
 void add_proc(struct pcb_t * proc);
 
+/* Remove a finished process from the running list */
+void finish_proc(struct pcb_t * proc);
+
+/* Find a process known to the scheduler by its PID */
+struct pcb_t * find_proc(uint32_t pid);
+
 #endif
 
 
@@ -7,6 +7,7 @@
 struct timer_id_t {
 	int done;
 	int fsh;
+	int skip;	/* Extra slots the device stays done (next_slots) */
 	pthread_cond_t event_cond;
 	pthread_mutex_t event_lock;
 	pthread_cond_t timer_cond;
@@ -23,6 +24,8 @@ void detach_event(struct timer_id_t * event);
 
 void next_slot(struct timer_id_t* timer_id);
 
+void next_slots(struct timer_id_t* timer_id, uint32_t n);
+
 uint64_t current_time();
 
 #endif
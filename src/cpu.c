@@ -3,6 +3,7 @@
 #include "mm.h"
 #include "syscall.h"
 #include "libmem.h"
+#include "inst.h"
 
 /*
  * calc(): mô phỏng lệnh tính toán (không làm gì thật),
@@ -78,6 +79,89 @@ int write(
     return write_mem(proc->regs[destination] + offset, proc, data);
 }
 
+/*
+ * memset_data(): ghi giá trị @value vào @size byte liên tiếp,
+ *                bắt đầu từ regs[destination] + offset.
+ */
+int memset_data(struct pcb_t *proc, uint32_t destination, uint32_t offset,
+                uint32_t size, BYTE value)
+{
+    uint32_t i;
+
+    for (i = 0; i < size; i++)
+        if (write_mem(proc->regs[destination] + offset + i, proc, value))
+            return 1;
+    return 0;
+}
+
+/*
+ * memxfer_data(): chép (result == NULL) hoặc so sánh @size byte
+ *                 giữa regs[source] và regs[destination].
+ */
+int memxfer_data(struct pcb_t *proc, uint32_t source, uint32_t destination,
+                 uint32_t size, int *result)
+{
+    uint32_t i;
+    BYTE a, b;
+
+    for (i = 0; i < size; i++)
+    {
+        if (read_mem(proc->regs[source] + i, proc, &a))
+            return 1;
+        if (result == NULL)
+        {
+            if (write_mem(proc->regs[destination] + i, proc, a))
+                return 1;
+            continue;
+        }
+        if (read_mem(proc->regs[destination] + i, proc, &b))
+            return 1;
+        if (a != b)
+        {
+            *result = ((unsigned char)a > (unsigned char)b) ? 1 : -1;
+            return 0;
+        }
+    }
+    if (result)
+        *result = 0;
+    return 0;
+}
+
+/*
+ * fetch(): đọc và giải mã lệnh tại PC, trả về độ dài lệnh (0 nếu lỗi,
+ *          khi đó process bị kết thúc).
+ *
+ * Với MM_CODE_PAGING, byte lệnh được đọc qua MMU từ code VMA (qua
+ * i-TLB của CPU), mỗi lần đọc tối đa một trang; lệnh nằm vắt qua
+ * biên trang cần thêm một lần đọc trang kế tiếp. Nếu không, lệnh lấy
+ * từ bản đã giải mã sẵn của code segment (code->insts).
+ */
+static uint32_t fetch(struct pcb_t *proc, struct inst_t *ins)
+{
+#ifdef MM_CODE_PAGING
+    uint8_t buf[INST_MAX_LEN];
+    int n = libfetch(proc, proc->pc, buf, INST_MAX_LEN);
+
+    if (n > 0 && inst_length(buf, n) == 0)
+    {
+        int m = libfetch(proc, proc->pc + n, buf + n, INST_MAX_LEN - n);
+        n = (m > 0) ? n + m : -1;
+    }
+    if (n <= 0 || inst_length(buf, n) == 0)
+    {
+        // không đọc được lệnh (hết code VMA / RAM+SWAP) → kết thúc process
+        printf("\tfetch: PID %d cannot fetch instruction at %u, terminated\n",
+               proc->pid, proc->pc);
+        proc->pc = proc->code->size;
+        return 0;
+    }
+    return inst_decode(buf, ins);
+#else
+    *ins = proc->code->insts[proc->ip];
+    return proc->code->len[proc->ip];
+#endif
+}
+
 /*
  * run(): thực thi 1 lệnh của tiến trình.
  *
@@ -94,8 +178,19 @@ int run(struct pcb_t *proc)
         return 1;
     }
 
-    struct inst_t ins = proc->code->text[proc->pc];
-    proc->pc++;    // move PC to next instruction
+    struct inst_t ins;
+    uint32_t len = fetch(proc, &ins);
+
+    if (len == 0)
+        return 1;
+
+    // CALC-N (đã gộp) chưa chạy hết N đơn vị → giữ nguyên PC
+    if (ins.opcode == CALC && ++proc->calc_done < ins.arg_0)
+        return calc(proc);
+
+    proc->calc_done = 0;
+    proc->pc += len;    // move PC to next instruction
+    proc->ip++;
 
     int stat = 1;
     
@@ -137,6 +232,33 @@ int run(struct pcb_t *proc)
 #endif
         break;
 
+    case MEMSET:
+#ifdef MM_PAGING
+        stat = libmemset(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
+#else
+        stat = memset_data(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
+#endif
+        break;
+
+    case MEMCPY:
+#ifdef MM_PAGING
+        stat = libmemcpy(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+#else
+        stat = memxfer_data(proc, ins.arg_0, ins.arg_1, ins.arg_2, NULL);
+#endif
+        break;
+
+    case MEMCMP:
+#ifdef MM_PAGING
+        stat = libmemcmp(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+#else
+        {
+            int result;
+            stat = memxfer_data(proc, ins.arg_0, ins.arg_1, ins.arg_2, &result);
+        }
+#endif
+        break;
+
     case SYSCALL:
         stat = libsyscall(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
         if(stat == 0) return 0;
@@ -148,3 +270,42 @@ int run(struct pcb_t *proc)
 
     return stat;
 }
+
+/*
+ * run_slots(): thực thi lệnh tại PC trong tối đa @budget time slot.
+ *
+ * - CALC-N tiêu thụ min(số đơn vị còn lại, budget) slot trong một bước,
+ *   thời gian mô phỏng giống hệt khi chạy từng CALC riêng lẻ
+ * - Các lệnh khác chạy qua run() và tốn 1 slot
+ */
+uint32_t run_slots(struct pcb_t *proc, uint32_t budget, int *stat)
+{
+    if (proc->pc < proc->code->size &&
+        INST_OPCODE(proc->code->text[proc->pc]) == CALC && budget > 1)
+    {
+        struct inst_t ins;
+        uint32_t len = fetch(proc, &ins);
+
+        if (len == 0)
+        {
+            *stat = 1;
+            return 1;
+        }
+
+        uint32_t left = ins.arg_0 - proc->calc_done;
+        uint32_t used = (left < budget) ? left : budget;
+
+        proc->calc_done += used;
+        if (proc->calc_done >= ins.arg_0)
+        {
+            proc->calc_done = 0;
+            proc->pc += len;
+            proc->ip++;
+        }
+        *stat = 0;
+        return used;
+    }
+
+    *stat = run(proc);
+    return 1;
+}
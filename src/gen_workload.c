@@ -0,0 +1,427 @@
+/*
+ * Synthetic workload generator
+ *
+ * Writes a configuration file input/NAME and the programs it runs,
+ * input/proc/NAME_<k>, with parameterised process count, arrival rate,
+ * priority mix, instruction mix, allocation sizes and access locality.
+ * Run without arguments for the list of options.
+ */
+
+#include "os-cfg.h"
+#include "queue.h"
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NREGS 10	/* Registers usable as region IDs (pcb_t.regs) */
+#define MAX_MEMSET 256	/* Upper bound of one MEMSET/MEMCPY/MEMCMP length */
+
+/* The config matches the os build by default: no memory line when the
+ * sizes are fixed at compile time, -F writes the other format */
+#ifdef MM_FIXED_MEMSZ
+#define GEN_MEMLINE 0
+#else
+#define GEN_MEMLINE 1
+#endif
+
+enum gen_op { OP_CALC, OP_ALLOC, OP_FREE, OP_READ, OP_WRITE,
+	OP_MEMSET, OP_MEMCPY, OP_MEMCMP, NR_OPS };
+
+static const char * op_name[NR_OPS] = {
+	"calc", "alloc", "free", "read", "write", "memset", "memcpy", "memcmp",
+};
+
+/* Distribution over [0, n): uniform, Zipf with exponent s, sequential
+ * (a cursor per user) or a fixed value */
+enum dist_kind { DIST_UNIFORM, DIST_ZIPF, DIST_SEQ, DIST_FIXED };
+
+struct dist {
+	enum dist_kind kind;
+	double s;	/* Zipf exponent */
+	long value;	/* Fixed value */
+	double * cdf;	/* Zipf CDF table of the last n drawn */
+	long n;
+};
+
+static struct gen_cfg {
+	const char * name;
+	const char * dir;
+	long nproc;
+	long nprog;
+	int ncpus;
+	int slice;
+	double rate;
+	struct dist prio;
+	long ninst;
+	double mix[NR_OPS];
+	long alloc_min, alloc_max;
+	struct dist loc;
+	int memline;
+	long mem[5];
+	uint64_t seed;
+} cfg = {
+	.dir = "input",
+	.nproc = 100,
+	.nprog = 0,
+	.ncpus = 4,
+	.slice = 2,
+	.rate = 1.0,
+	.prio = { DIST_UNIFORM, 0, 0, NULL, 0 },
+	.ninst = 100,
+	.mix = { 60, 8, 6, 10, 10, 2, 2, 2 },
+	.alloc_min = 64,
+	.alloc_max = 4096,
+	.loc = { DIST_SEQ, 0, 0, NULL, 0 },
+	.memline = GEN_MEMLINE,
+	.mem = { 1048576, 16777216, 0, 0, 0 },
+	.seed = 1,
+};
+
+/* xorshift64*: small, fast and reproducible across libc versions */
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/* Uniform double in [0, 1) */
+static double rng_unit(void) {
+	return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static long rng_range(long n) {
+	return (long)(rng_unit() * n);
+}
+
+/* Zipf sampling by inverse CDF, each distribution keeps the table
+ * of the last n it was drawn over */
+static long zipf_sample(struct dist * d, long n) {
+	long lo = 0, hi = n - 1;
+	double u;
+
+	if (n != d->n) {
+		double sum = 0;
+		long i;
+
+		d->cdf = (double *)realloc(d->cdf, n * sizeof(double));
+		for (i = 0; i < n; i++) {
+			sum += 1.0 / pow((double)(i + 1), d->s);
+			d->cdf[i] = sum;
+		}
+		for (i = 0; i < n; i++)
+			d->cdf[i] /= sum;
+		d->n = n;
+	}
+
+	u = rng_unit();
+	while (lo < hi) {
+		long mid = (lo + hi) / 2;
+		if (d->cdf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Draw from [d] over [0, n). [cursor] is the state of a sequential user */
+static long dist_sample(struct dist * d, long n, long * cursor) {
+	long v;
+
+	if (n <= 0)
+		return 0;
+	switch (d->kind) {
+	case DIST_ZIPF:
+		return zipf_sample(d, n);
+	case DIST_SEQ:
+		v = *cursor % n;
+		*cursor = v + 1;
+		return v;
+	case DIST_FIXED:
+		return (d->value < n) ? d->value : n - 1;
+	default:
+		return rng_range(n);
+	}
+}
+
+static int parse_dist(const char * arg, struct dist * d) {
+	if (!strcmp(arg, "uniform") || !strcmp(arg, "rand")) {
+		d->kind = DIST_UNIFORM;
+	} else if (!strcmp(arg, "seq")) {
+		d->kind = DIST_SEQ;
+	} else if (!strncmp(arg, "zipf", 4)) {
+		d->kind = DIST_ZIPF;
+		d->s = (arg[4] == ':') ? atof(arg + 5) : 1.0;
+		if (d->s <= 0)
+			return -1;
+	} else if (!strncmp(arg, "fixed:", 6)) {
+		d->kind = DIST_FIXED;
+		d->value = atol(arg + 6);
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+static int parse_mix(char * arg) {
+	char * tok;
+	int i;
+
+	memset(cfg.mix, 0, sizeof(cfg.mix));
+	for (tok = strtok(arg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+		char * eq = strchr(tok, '=');
+
+		if (eq == NULL)
+			return -1;
+		*eq = '\0';
+		for (i = 0; i < NR_OPS; i++)
+			if (!strcmp(tok, op_name[i]))
+				break;
+		if (i == NR_OPS)
+			return -1;
+		cfg.mix[i] = atof(eq + 1);
+	}
+	return 0;
+}
+
+static void usage(const char * prog) {
+	printf("Usage: %s [options] NAME\n"
+	       "Write the config DIR/NAME and its programs DIR/proc/NAME_<k>\n"
+	       "  -n N          number of processes (%ld)\n"
+	       "  -k K          number of distinct programs (min(N, 16))\n"
+	       "  -c CPUS       number of CPUs (%d)\n"
+	       "  -t SLICE      time slice (%d)\n"
+	       "  -a RATE       mean arrivals per time slot, Poisson (%.1f)\n"
+	       "  -p DIST       priority mix over [0, %d): uniform | zipf[:S] | fixed:P\n"
+	       "  -i N          instructions per program (%ld)\n"
+	       "  -m MIX        instruction mix weights, e.g.\n"
+	       "                calc=60,alloc=8,free=6,read=10,write=10,memset=2,memcpy=2,memcmp=2\n"
+	       "  -z MIN:MAX    allocation size in bytes, log-uniform (%ld:%ld)\n"
+	       "  -l LOC        access locality in a region: seq | rand | zipf[:S]\n"
+	       "  -M R,S0,S1,S2,S3  MEMRAM and MEMSWP sizes (%ld,%ld,%ld,%ld,%ld)\n"
+#ifdef MM_FIXED_MEMSZ
+	       "  -F            write the memory line, for an os built without MM_FIXED_MEMSZ\n"
+#else
+	       "  -F            legacy config without the memory line (MM_FIXED_MEMSZ)\n"
+#endif
+	       "  -s SEED       random seed (%llu)\n"
+	       "  -d DIR        input directory (%s)\n"
+	       "With a skewed -p and a high -a, more than MAX_QUEUE_SIZE (%d)\n"
+	       "processes can wait on one priority level: the os queues grow past\n"
+	       "it, an os with fixed size queues drops the extra processes.\n",
+	       prog, cfg.nproc, cfg.ncpus, cfg.slice, cfg.rate, MAX_PRIO,
+	       cfg.ninst, cfg.alloc_min, cfg.alloc_max,
+	       cfg.mem[0], cfg.mem[1], cfg.mem[2], cfg.mem[3], cfg.mem[4],
+	       (unsigned long long)cfg.seed, cfg.dir, MAX_QUEUE_SIZE);
+}
+
+/* Pick an op by the mix weights */
+static enum gen_op pick_op(double total) {
+	double u = rng_unit() * total;
+	int i;
+
+	for (i = 0; i < NR_OPS - 1; i++) {
+		if (u < cfg.mix[i])
+			return (enum gen_op)i;
+		u -= cfg.mix[i];
+	}
+	return (enum gen_op)(NR_OPS - 1);
+}
+
+/* Pick a register with (used != 0) or without (used == 0) a region,
+ * different from [other]. Return -1 if there is none */
+static int pick_reg(const long * size, int used, int other) {
+	int cand[NREGS], n = 0, r;
+
+	for (r = 0; r < NREGS; r++)
+		if (r != other && ((size[r] != 0) == (used != 0)))
+			cand[n++] = r;
+	return n ? cand[rng_range(n)] : -1;
+}
+
+static long alloc_size(void) {
+	double lo = log((double)cfg.alloc_min);
+	double hi = log((double)cfg.alloc_max + 1);
+
+	return (long)exp(lo + rng_unit() * (hi - lo));
+}
+
+/* Write one program. Instructions are only emitted when they are valid:
+ * reads and writes stay inside allocated regions, FREE only targets an
+ * allocated register, otherwise the op is replaced by a valid one */
+static int gen_program(const char * path, long prio) {
+	FILE * f = fopen(path, "w");
+	long size[NREGS] = { 0 };
+	long cursor[NREGS] = { 0 };
+	double total = 0;
+	long k;
+	int i;
+
+	if (f == NULL) {
+		printf("Cannot create program at %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	for (i = 0; i < NR_OPS; i++)
+		total += cfg.mix[i];
+
+	fprintf(f, "%ld %ld\n", prio, cfg.ninst);
+	for (k = 0; k < cfg.ninst; k++) {
+		enum gen_op op = pick_op(total);
+		int r = pick_reg(size, 1, -1);
+		int r2 = (r >= 0) ? pick_reg(size, 1, r) : -1;
+		long off, len;
+
+		/* Fall back to an op that is valid in the current state */
+		if (op == OP_ALLOC && pick_reg(size, 0, -1) < 0)
+			op = OP_FREE;
+		if ((op == OP_MEMCPY || op == OP_MEMCMP) && r2 < 0)
+			op = OP_WRITE;
+		if (op != OP_CALC && op != OP_ALLOC && r < 0)
+			op = OP_ALLOC;
+
+		switch (op) {
+		case OP_CALC:
+			fprintf(f, "calc\n");
+			break;
+		case OP_ALLOC:
+			r = pick_reg(size, 0, -1);
+			size[r] = alloc_size();
+			cursor[r] = 0;
+			fprintf(f, "alloc %ld %d\n", size[r], r);
+			break;
+		case OP_FREE:
+			fprintf(f, "free %d\n", r);
+			size[r] = 0;
+			break;
+		case OP_READ:
+			off = dist_sample(&cfg.loc, size[r], &cursor[r]);
+			i = pick_reg(size, 0, -1);
+			fprintf(f, "read %d %ld %d\n", r, off, (i >= 0) ? i : r);
+			break;
+		case OP_WRITE:
+			off = dist_sample(&cfg.loc, size[r], &cursor[r]);
+			fprintf(f, "write %ld %d %ld\n", 1 + rng_range(255), r, off);
+			break;
+		case OP_MEMSET:
+			off = dist_sample(&cfg.loc, size[r], &cursor[r]);
+			len = size[r] - off;
+			len = 1 + rng_range(len < MAX_MEMSET ? len : MAX_MEMSET);
+			cursor[r] = off + len;
+			fprintf(f, "memset %d %ld %ld %ld\n", r, off, len, rng_range(256));
+			break;
+		case OP_MEMCPY:
+		case OP_MEMCMP:
+			len = (size[r] < size[r2]) ? size[r] : size[r2];
+			len = 1 + rng_range(len < MAX_MEMSET ? len : MAX_MEMSET);
+			fprintf(f, "%s %d %d %ld\n", op_name[op], r, r2, len);
+			break;
+		default:
+			break;
+		}
+	}
+
+	fclose(f);
+	return 0;
+}
+
+int main(int argc, char * argv[]) {
+	char path[4096];
+	FILE * f;
+	double t = 0;
+	long i, prio_cursor = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:k:c:t:a:p:i:m:z:l:M:Fs:d:h")) != -1) {
+		switch (c) {
+		case 'n': cfg.nproc = atol(optarg); break;
+		case 'k': cfg.nprog = atol(optarg); break;
+		case 'c': cfg.ncpus = atoi(optarg); break;
+		case 't': cfg.slice = atoi(optarg); break;
+		case 'a': cfg.rate = atof(optarg); break;
+		case 'i': cfg.ninst = atol(optarg); break;
+		case 'F': cfg.memline = !GEN_MEMLINE; break;
+		case 's': cfg.seed = strtoull(optarg, NULL, 0); break;
+		case 'd': cfg.dir = optarg; break;
+		case 'p':
+			if (parse_dist(optarg, &cfg.prio) || cfg.prio.kind == DIST_SEQ) {
+				printf("Bad priority mix: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'l':
+			if (parse_dist(optarg, &cfg.loc) || cfg.loc.kind == DIST_FIXED) {
+				printf("Bad locality: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'm':
+			if (parse_mix(optarg)) {
+				printf("Bad instruction mix: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'z':
+			if (sscanf(optarg, "%ld:%ld", &cfg.alloc_min, &cfg.alloc_max) != 2 ||
+			    cfg.alloc_min < 1 || cfg.alloc_max < cfg.alloc_min) {
+				printf("Bad allocation size range: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'M':
+			if (sscanf(optarg, "%ld,%ld,%ld,%ld,%ld", &cfg.mem[0], &cfg.mem[1],
+				   &cfg.mem[2], &cfg.mem[3], &cfg.mem[4]) != 5) {
+				printf("Bad memory sizes: %s\n", optarg);
+				return 1;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return c != 'h';
+		}
+	}
+	if (optind != argc - 1 || cfg.nproc < 1 || cfg.ninst < 1 ||
+	    cfg.rate <= 0 || cfg.ncpus < 1 || cfg.slice < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	cfg.name = argv[optind];
+	if (cfg.nprog <= 0)
+		cfg.nprog = (cfg.nproc < 16) ? cfg.nproc : 16;
+	rng_state = cfg.seed ? cfg.seed : 0x9E3779B97F4A7C15ULL;
+
+	/* Programs */
+	for (i = 0; i < cfg.nprog; i++) {
+		snprintf(path, sizeof(path), "%s/proc/%s_%ld", cfg.dir, cfg.name, i);
+		if (gen_program(path, dist_sample(&cfg.prio, MAX_PRIO, &prio_cursor)))
+			return 1;
+	}
+
+	/* Configuration: arrivals in time order, exponential inter-arrival */
+	snprintf(path, sizeof(path), "%s/%s", cfg.dir, cfg.name);
+	if ((f = fopen(path, "w")) == NULL) {
+		printf("Cannot create config at %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	fprintf(f, "%d %d %ld\n", cfg.slice, cfg.ncpus, cfg.nproc);
+	if (cfg.memline)
+		fprintf(f, "%ld %ld %ld %ld %ld\n", cfg.mem[0],
+			cfg.mem[1], cfg.mem[2], cfg.mem[3], cfg.mem[4]);
+	for (i = 0; i < cfg.nproc; i++) {
+		fprintf(f, "%lu %s_%ld %ld\n", (unsigned long)t, cfg.name,
+			rng_range(cfg.nprog),
+			dist_sample(&cfg.prio, MAX_PRIO, &prio_cursor));
+		t += -log(1.0 - rng_unit()) / cfg.rate;
+	}
+	fclose(f);
+
+	printf("%s: %ld processes over %lu slots, %ld programs of %ld instructions\n",
+	       path, cfg.nproc, (unsigned long)t, cfg.nprog, cfg.ninst);
+	return 0;
+}
@@ -0,0 +1,112 @@
+
+#include "inst.h"
+
+/* Number of encoded operands of each opcode */
+static const uint8_t inst_nargs[INST_OPCODE_MASK + 1] = {
+	[CALC] = 0,
+	[ALLOC] = 2,
+	[FREE] = 1,
+	[READ] = 3,
+	[WRITE] = 3,
+	[SYSCALL] = 4,
+	[MEMSET] = 4,
+	[MEMCPY] = 3,
+	[MEMCMP] = 3,
+};
+
+static uint32_t put_varint(uint8_t * buf, arg_t val) {
+	uint32_t len = 0;
+
+	while (val >= 0x80) {
+		buf[len++] = (uint8_t)(val | 0x80);
+		val >>= 7;
+	}
+	buf[len++] = (uint8_t)val;
+	return len;
+}
+
+static uint32_t get_varint(const uint8_t * buf, arg_t * val) {
+	uint32_t len = 0;
+	int shift = 0;
+	arg_t v = 0;
+
+	/* Fast path: operands below 128 take a single byte */
+	if (!(buf[0] & 0x80)) {
+		*val = buf[0];
+		return 1;
+	}
+
+	do {
+		v |= (arg_t)(buf[len] & 0x7F) << shift;
+		shift += 7;
+	} while (buf[len++] & 0x80);
+
+	*val = v;
+	return len;
+}
+
+uint32_t inst_encode(uint8_t * buf, const struct inst_t * ins) {
+	const arg_t args[4] = { ins->arg_0, ins->arg_1, ins->arg_2, ins->arg_3 };
+	uint32_t len = 1;
+	int i;
+
+	buf[0] = (uint8_t)ins->opcode;
+	if (ins->opcode == CALC) {
+		/* CALC-1 stays one byte */
+		if (ins->arg_0 > 1) {
+			buf[0] |= INST_EXT_FLAG;
+			len += put_varint(buf + len, ins->arg_0);
+		}
+		return len;
+	}
+
+	for (i = 0; i < inst_nargs[ins->opcode]; i++)
+		len += put_varint(buf + len, args[i]);
+	return len;
+}
+
+uint32_t inst_decode(const uint8_t * buf, struct inst_t * ins) {
+	uint32_t len = 1;
+	int nargs;
+
+	ins->opcode = INST_OPCODE(buf[0]);
+	ins->arg_0 = ins->arg_1 = ins->arg_2 = ins->arg_3 = 0;
+	if (ins->opcode == CALC) {
+		ins->arg_0 = 1;
+		if (buf[0] & INST_EXT_FLAG)
+			len += get_varint(buf + len, &ins->arg_0);
+		return len;
+	}
+
+	nargs = inst_nargs[ins->opcode];
+	if (nargs > 0)
+		len += get_varint(buf + len, &ins->arg_0);
+	if (nargs > 1)
+		len += get_varint(buf + len, &ins->arg_1);
+	if (nargs > 2)
+		len += get_varint(buf + len, &ins->arg_2);
+	if (nargs > 3)
+		len += get_varint(buf + len, &ins->arg_3);
+	return len;
+}
+
+uint32_t inst_length(const uint8_t * buf, uint32_t avail) {
+	uint32_t len = 1;
+	int nargs;
+
+	if (avail == 0)
+		return 0;
+	if (INST_OPCODE(buf[0]) == CALC)
+		nargs = (buf[0] & INST_EXT_FLAG) ? 1 : 0;
+	else
+		nargs = inst_nargs[INST_OPCODE(buf[0])];
+
+	while (nargs-- > 0) {
+		/* Skip one varint, it ends on a byte without the high bit */
+		do {
+			if (len >= avail)
+				return 0;
+		} while (buf[len++] & 0x80);
+	}
+	return len;
+}
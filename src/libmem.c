@@ -24,40 +24,166 @@
 
 static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
 
-/*enlist_vm_freerg_list - add new rg to freerg_list
- *@mm: memory region
+/*enlist_vma_freerg - add new rg to the freerg_list of a given VMA
+ *@vma: vm area owning the region
  *@rg_elmt: new region
- *
  */
-// Thêm một region mới vào danh sách region rãnh của VMA
-int enlist_vm_freerg_list(struct mm_struct *mm, struct vm_rg_struct *rg_elmt)
+static int enlist_vma_freerg(struct vm_area_struct *vma, struct vm_rg_struct *rg_elmt)
 {
-  struct vm_rg_struct *rg_node = mm->mmap->vm_freerg_list;
+  struct vm_rg_struct **prg, *rg_node;
 
   if (rg_elmt->rg_start >= rg_elmt->rg_end)
     return -1;
 
+  /* Gộp các region rãnh liền kề với region mới để danh sách không
+   * bị phân mảnh dần khi process liên tục cấp phát / giải phóng */
+  prg = &vma->vm_freerg_list;
+  while ((rg_node = *prg) != NULL)
+  {
+    if (rg_node->rg_start < rg_node->rg_end &&
+        (rg_node->rg_end == rg_elmt->rg_start ||
+         rg_node->rg_start == rg_elmt->rg_end))
+    {
+      if (rg_node->rg_start < rg_elmt->rg_start)
+        rg_elmt->rg_start = rg_node->rg_start;
+      else
+        rg_elmt->rg_end = rg_node->rg_end;
+      *prg = rg_node->rg_next;
+      free(rg_node);
+      prg = &vma->vm_freerg_list;   // duyệt lại từ đầu
+      continue;
+    }
+    prg = &rg_node->rg_next;
+  }
+
+  rg_node = vma->vm_freerg_list;
   if (rg_node != NULL)
     rg_elmt->rg_next = rg_node;
 
   /* Enlist the new region */
-  mm->mmap->vm_freerg_list = rg_elmt;
+  vma->vm_freerg_list = rg_elmt;
 
   return 0;
 }
 
-/*get_symrg_byid - get mem region by region ID
+/*enlist_vm_freerg_list - add new rg to freerg_list
  *@mm: memory region
+ *@rg_elmt: new region
+ *
+ */
+// Thêm một region mới vào danh sách region rãnh của VMA
+int enlist_vm_freerg_list(struct mm_struct *mm, struct vm_rg_struct *rg_elmt)
+{
+  return enlist_vma_freerg(mm->mmap, rg_elmt);
+}
+
+/*get_symrg_byid - get mem region by region ID
+ *@caller: caller, owner of the symbol table
  *@rgid: region ID act as symbol index of variable
  *
  */
 // Lấy region theo ID (dùng làm chỉ số trong bảng symbol của biến)
-struct vm_rg_struct *get_symrg_byid(struct mm_struct *mm, int rgid)
+struct vm_rg_struct *get_symrg_byid(struct pcb_t *caller, int rgid)
 {
-  if (rgid < 0 || rgid > PAGING_MAX_SYMTBL_SZ)
+  if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ)
     return NULL;
 
-  return &mm->symrgtbl[rgid];
+  return &caller->cold->symrgtbl[rgid];
+}
+
+/*pgn_list_remove - drop every entry of a page from a page list
+ *@plist: page list (FIFO of resident pages)
+ *@pgn: page number
+ */
+static void pgn_list_remove(struct pgn_t **plist, addr_t pgn)
+{
+  struct pgn_t *pg;
+
+  while ((pg = *plist) != NULL)
+  {
+    if (pg->pgn == pgn)
+    {
+      *plist = pg->pg_next;
+      free(pg);
+    }
+    else
+      plist = &pg->pg_next;
+  }
+}
+
+/*pg_ref_range - count one more live region on the pages of a range
+ *@mm: memory region
+ *@start: range start
+ *@end: range end (exclusive)
+ *
+ * Regions are not page aligned, so regions of several processes may sit
+ * on the same page. mm->pgusr keeps the number of live regions per page.
+ */
+static void pg_ref_range(struct mm_struct *mm, addr_t start, addr_t end)
+{
+  addr_t pgn, last = end - 1;
+
+  if (start >= end)
+    return;
+
+  if (PAGING_PGN(last) >= mm->pgusr_sz)
+  {
+    addr_t n = mm->pgusr_sz ? mm->pgusr_sz : 64;
+
+    while (n <= PAGING_PGN(last))
+      n *= 2;
+    mm->pgusr = realloc(mm->pgusr, n * sizeof(uint32_t));
+    memset(mm->pgusr + mm->pgusr_sz, 0, (n - mm->pgusr_sz) * sizeof(uint32_t));
+    mm->pgusr_sz = n;
+  }
+
+  for (pgn = PAGING_PGN(start); pgn <= PAGING_PGN(last); pgn++)
+    mm->pgusr[pgn]++;
+}
+
+/*pg_unref_range - drop one live region from the pages of a range
+ *@caller: caller
+ *@start: range start
+ *@end: range end (exclusive)
+ *
+ * A page left without any live region gives its RAM frame or swap slot
+ * back to the device, its PTE is cleared and the emptied page table pages
+ * are pruned. Caller holds mmvm_lock.
+ */
+static void pg_unref_range(struct pcb_t *caller, addr_t start, addr_t end)
+{
+  struct mm_struct *mm = caller->krnl->mm;
+  addr_t pgn, last = end - 1;
+  uint32_t pte;
+
+  if (start >= end)
+    return;
+
+  for (pgn = PAGING_PGN(start); pgn <= PAGING_PGN(last); pgn++)
+  {
+    if (--mm->pgusr[pgn] > 0)
+      continue;   // Trang còn được region khác sử dụng
+
+    pte = pte_get_entry(caller, pgn);
+    if (!PAGING_PAGE_PRESENT(pte))
+      continue;
+
+    if (pte & PAGING_PTE_SWAPPED_MASK)
+    {
+#ifdef MM_ZSWAP
+      if (PAGING_PTE_SWPTYP(pte) == PAGING_SWPTYP_ZSWAP)
+        zswap_free(PAGING_SWP(pte));
+      else
+#endif
+      MEMPHY_put_freefp(caller->krnl->mswp[PAGING_PTE_SWPTYP(pte)],
+                        PAGING_SWP(pte));
+    }
+    else if (!(pte & PAGING_PTE_ZERO_MASK))
+      MEMPHY_put_freefp(caller->krnl->mram, PAGING_FPN(pte));
+
+    pte_clear(caller, pgn);
+    pgn_list_remove(&mm->fifo_pgn, pgn);
+  }
 }
 
 /*__alloc - allocate a region memory
@@ -89,6 +215,9 @@ struct vm_rg_struct *get_symrg_byid(struct mm_struct *mm, int rgid)
  */
 int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *alloc_addr)
 {
+  if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ)
+    return -1;
+
   /*Allocate at the toproof */
   pthread_mutex_lock(&mmvm_lock);
   struct vm_rg_struct rgnode;
@@ -97,8 +226,9 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *allo
   // cấp phát vùng nhớ ảo trong VMA chỉ định thông qua rgid
   if (get_free_vmrg_area(caller, vmaid, size, &rgnode) == 0)
   {
-    caller->krnl->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
-    caller->krnl->mm->symrgtbl[rgid].rg_end = rgnode.rg_end;
+    caller->cold->symrgtbl[rgid].rg_start = rgnode.rg_start;
+    caller->cold->symrgtbl[rgid].rg_end = rgnode.rg_end;
+    pg_ref_range(caller->krnl->mm, rgnode.rg_start, rgnode.rg_end);
     *alloc_addr = rgnode.rg_start;
     pthread_mutex_unlock(&mmvm_lock);
     return 0;
@@ -129,8 +259,9 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *allo
   syscall(caller->krnl, caller->pid, 17, &regs); /* SYSCALL 17 sys_memmap */
 
   /*Successful increase limit */
-  caller->krnl->mm->symrgtbl[rgid].rg_start = old_sbrk;
-  caller->krnl->mm->symrgtbl[rgid].rg_end = old_sbrk + size;
+  caller->cold->symrgtbl[rgid].rg_start = old_sbrk;
+  caller->cold->symrgtbl[rgid].rg_end = old_sbrk + size;
+  pg_ref_range(caller->krnl->mm, old_sbrk, old_sbrk + size);
   *alloc_addr = old_sbrk;
 
   /* Advance program break so subsequent allocations do not overlap */
@@ -152,14 +283,14 @@ int __free(struct pcb_t *caller, int vmaid, int rgid)
 {
   pthread_mutex_lock(&mmvm_lock);
 
-  if (rgid < 0 || rgid > PAGING_MAX_SYMTBL_SZ)
+  if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ)
   {
     pthread_mutex_unlock(&mmvm_lock);
     return -1;
   }
 
   /* TODO: Manage the collect freed region to freerg_list */
-  struct vm_rg_struct *rgnode = get_symrg_byid(caller->krnl->mm, rgid);
+  struct vm_rg_struct *rgnode = get_symrg_byid(caller, rgid);
 
   if (rgnode->rg_start >= rgnode->rg_end)
   {
@@ -174,6 +305,9 @@ int __free(struct pcb_t *caller, int vmaid, int rgid)
   rgnode->rg_start = rgnode->rg_end = 0;
   rgnode->rg_next = NULL;
 
+  /* Pages no longer covered by any live region are given back */
+  pg_unref_range(caller, freerg_node->rg_start, freerg_node->rg_end);
+
   /*enlist the obsoleted memory region */
   enlist_vm_freerg_list(caller->krnl->mm, freerg_node);
 
@@ -245,87 +379,394 @@ int libfree(struct pcb_t *proc, uint32_t reg_index)
   return 0;//val;
 }
 
-/*pg_getpage - get the page in ram
- *@mm: memory region
- *@pagenum: PGN
- *@framenum: return FPN
- *@caller: caller
+#ifdef MM_SWAP_CLUSTER_ORDER
+/* Open swap cluster: slots [next, end) of device id are reserved for
+ * the next swap-outs, which land one after the other */
+static struct {
+  int id;
+  addr_t next;
+  addr_t end;
+} swp_clu = { -1, 0, 0 };
+#endif
+
+static struct {
+  uint64_t slots;
+  uint64_t clusters;
+  uint64_t adjacent;    /* slot right after the previous one, same device */
+  int last_id;
+  addr_t last;
+} swp_stat = { 0, 0, 0, -1, 0 };
+
+#ifdef MM_ZERO_PAGE
+static struct {
+  uint64_t mapped;      /* read faults served by the zero frame */
+  uint64_t cow;         /* first writes given a private frame */
+  uint64_t dropped;     /* all-zero pages evicted without a slot */
+} zero_stat;
+#endif
+
+/*swap_get_slot - take a free swap slot
+ *@krnl: kernel
+ *@swptyp: return index of the MEMSWP device
+ *@swpfpn: return slot (frame) in that device
  *
+ * With MM_SWAP_CLUSTER_ORDER, slots come from a cluster of
+ * 2^MM_SWAP_CLUSTER_ORDER adjacent slots reserved on one device, the
+ * next cluster is taken on the next device. Otherwise, or when no
+ * device has a free cluster left, single slots are striped round robin
+ * over the non-empty MEMSWP devices, a full device is skipped. The
+ * device index is the swap type of the PTE. Caller holds mmvm_lock.
  */
-int pg_getpage(struct mm_struct *mm, addr_t pgn, addr_t *fpn, struct pcb_t *caller)
+static int swap_get_slot(struct krnl_t *krnl, int *swptyp, addr_t *swpfpn)
 {
+  int i, id;
 
-  uint32_t pte = pte_get_entry(caller, pgn);
+#ifdef MM_SWAP_CLUSTER_ORDER
+  if (swp_clu.id < 0 || swp_clu.next == swp_clu.end)
+  {
+    swp_clu.id = -1;
+    for (i = 1; i <= PAGING_MAX_MMSWP; i++)
+    {
+      id = (krnl->active_mswp_id + i) % PAGING_MAX_MMSWP;
+      if (krnl->mswp[id]->fp_num == 0)
+        continue;
 
-  /* Nếu trang chưa hiện diện trong RAM */
-  if (!PAGING_PAGE_PRESENT(pte))
-  { 
-    addr_t vicpgn, swpfpn;
+      if (MEMPHY_alloc_order(krnl->mswp[id], MM_SWAP_CLUSTER_ORDER,
+                             &swp_clu.next) == 0)
+      {
+        krnl->active_mswp_id = id;
+        krnl->active_mswp = krnl->mswp[id];
+        swp_clu.id = id;
+        swp_clu.end = swp_clu.next + (1 << MM_SWAP_CLUSTER_ORDER);
+        swp_stat.clusters++;
+        break;
+      }
+    }
+  }
 
-    /* Tìm trang nạn nhân (victim page) để đẩy ra ngoài swap */
-    if (find_victim_page(mm, &vicpgn) == -1)
+  if (swp_clu.id >= 0)
+  {
+    *swptyp = swp_clu.id;
+    *swpfpn = swp_clu.next++;
+    goto found;
+  }
+#endif
+
+  for (i = 1; i <= PAGING_MAX_MMSWP; i++)
+  {
+    id = (krnl->active_mswp_id + i) % PAGING_MAX_MMSWP;
+    if (krnl->mswp[id]->fp_num == 0)
+      continue;   // thiết bị swap không được cấu hình
+
+    if (MEMPHY_get_freefp(krnl->mswp[id], swpfpn) == 0)
     {
-      return -1;   // Không tìm được victim page
+      krnl->active_mswp_id = id;
+      krnl->active_mswp = krnl->mswp[id];
+      *swptyp = id;
+      goto found;
     }
+  }
+
+  return -1;
 
-    /* Lấy một frame trống trong vùng swap */
-    if (MEMPHY_get_freefp(caller->krnl->active_mswp, &swpfpn) == -1)
+found:
+  swp_stat.slots++;
+  if (*swptyp == swp_stat.last_id && *swpfpn == swp_stat.last + 1)
+    swp_stat.adjacent++;
+  swp_stat.last_id = *swptyp;
+  swp_stat.last = *swpfpn;
+  return 0;
+}
+
+/*
+ * libswap_report - print how swap slots were handed out
+ */
+void libswap_report(void)
+{
+  printf("Swap slots: %llu taken, %llu clusters, %.1f%% adjacent to the previous\n",
+         (unsigned long long)swp_stat.slots,
+         (unsigned long long)swp_stat.clusters,
+         swp_stat.slots ? 100.0 * swp_stat.adjacent / swp_stat.slots : 0.0);
+#ifdef MM_ZERO_PAGE
+  printf("Zero pages: %llu read faults mapped, %llu copied on write, "
+         "%llu evicted without a slot\n",
+         (unsigned long long)zero_stat.mapped,
+         (unsigned long long)zero_stat.cow,
+         (unsigned long long)zero_stat.dropped);
+#endif
+}
+
+/*swap_out_page - move a victim page out of its RAM frame
+ *@caller: caller
+ *@vicpgn: victim PGN
+ *@vicfpn: RAM frame of the victim
+ *@spare_ok: the compressed pool may keep the victim frame
+ *
+ * An all-zero page is put back on the shared zero frame and takes no
+ * swap slot. Otherwise the page goes to the compressed pool when it
+ * fits, else to the swap device. The PTE of the victim is switched to
+ * its swap location. Return 1 when the compressed pool kept the victim
+ * frame for itself, the frame is then not free.
+ */
+static int swap_out_page(struct pcb_t *caller, addr_t vicpgn, addr_t vicfpn,
+                         int spare_ok)
+{
+  struct memphy_struct *mram = caller->krnl->mram;
+  struct memphy_struct *mswp;
+  addr_t swpfpn;
+  int swptyp;
+
+#ifdef MM_ZERO_PAGE
+  /* Trang toàn số 0: chỉ cần cờ ZERO trong PTE, không tốn slot swap */
+  if (MEMPHY_zero_frame(mram, &swpfpn) == 0 &&
+      MEMPHY_page_is_zero(mram, vicfpn))
+  {
+    pte_set_zero(caller, vicpgn, swpfpn);
+    MEMPHY_rmap_set(mram, vicfpn, NULL, 0);
+    zero_stat.dropped++;
+    return 0;
+  }
+#endif
+
+#ifdef MM_ZSWAP
+  /* Thử nén trang victim vào pool trước, chỉ ghi ra thiết bị swap
+     khi pool không còn chỗ hoặc trang nén kém. Pool nằm trong MEMRAM:
+     khi cần thêm frame mà RAM đầy, chính frame của victim thành frame
+     của pool (trả về 1) */
+  BYTE page[PAGING_PAGESZ];
+  int ret;
+  if (MEMPHY_read_page(mram, vicfpn, page) == 0 &&
+      (ret = zswap_store(page, &swpfpn, spare_ok ? &vicfpn : NULL)) >= 0)
+  {
+    pte_set_swap(caller, vicpgn, PAGING_SWPTYP_ZSWAP, swpfpn);
+    MEMPHY_rmap_set(mram, vicfpn, NULL, 0);
+    if (ret == 1)
+      MEMPHY_set_owner(mram, vicfpn, 0);
+    return ret;
+  }
+#endif
+
+  /* Lấy một frame trống trong vùng swap */
+  if (swap_get_slot(caller->krnl, &swptyp, &swpfpn) != 0)
+    return -1;   // Không còn frame trống trong swap
+  mswp = caller->krnl->mswp[swptyp];
+
+  /* Sao chép dữ liệu frame của victim từ RAM sang SWAP,
+     đánh dấu victim là 'bị swap' */
+  if (__swap_cp_page(mram, vicfpn, mswp, swpfpn) != 0) {
+    MEMPHY_put_freefp(mswp, swpfpn);
+    return -1;   // Lỗi copy
+  }
+  pte_set_swap(caller, vicpgn, swptyp, swpfpn);
+  MEMPHY_set_owner(mswp, swpfpn, MEMPHY_get_owner(mram, vicfpn));
+  MEMPHY_rmap_set(mswp, swpfpn, caller->krnl->mm, vicpgn);
+  MEMPHY_rmap_set(mram, vicfpn, NULL, 0);
+#ifdef MM_ZSWAP
+  zswap_account_dev(0);
+#endif
+  return 0;
+}
+
+/*swap_in_page - bring a swapped page back into a RAM frame
+ *@caller: caller
+ *@pte: PTE of the swapped page
+ *@tgtfpn: RAM frame receiving the page
+ *
+ * The swap slot or pool entry is released.
+ */
+static int swap_in_page(struct pcb_t *caller, uint32_t pte, addr_t tgtfpn)
+{
+  struct memphy_struct *mram = caller->krnl->mram;
+  struct memphy_struct *mswp;
+  addr_t swpoff = PAGING_SWP(pte);
+
+#ifdef MM_ZSWAP
+  if (PAGING_PTE_SWPTYP(pte) == PAGING_SWPTYP_ZSWAP)
+  {
+    /* Trang nằm trong pool nén → giải nén thẳng vào frame */
+    BYTE page[PAGING_PAGESZ];
+    if (zswap_load(swpoff, page) != 0)
+      return -1;
+    return MEMPHY_write_page(mram, tgtfpn, page);
+  }
+  zswap_account_dev(1);
+#endif
+
+  /* Swap type của PTE là chỉ số thiết bị MEMSWP chứa trang */
+  mswp = caller->krnl->mswp[PAGING_PTE_SWPTYP(pte)];
+  __swap_cp_page(mswp, swpoff, mram, tgtfpn);
+  MEMPHY_put_freefp(mswp, swpoff);
+  return 0;
+}
+
+/*find_victim_frame - global replacement through the reverse map
+ *@caller: caller
+ *@mm: mm of the faulting page
+ *@retpgn: return victim PGN
+ *
+ * A clock hand sweeps the RAM frames, the first frame whose reverse map
+ * entry still names a present page of @mm is the victim. Used when the
+ * FIFO of @mm has nothing left to evict. Caller holds mmvm_lock.
+ */
+static int find_victim_frame(struct pcb_t *caller, struct mm_struct *mm,
+                             addr_t *retpgn)
+{
+  static addr_t hand;
+  struct memphy_struct *mram = caller->krnl->mram;
+  struct mm_struct *owner;
+  addr_t n, fpn, pgn;
+  uint32_t pte;
+
+  for (n = 0; n < mram->fp_num; n++)
+  {
+    fpn = hand;
+    hand = (hand + 1) % mram->fp_num;
+
+    if (MEMPHY_rmap_get(mram, fpn, &owner, &pgn) != 0 || owner != mm)
+      continue;
+
+    pte = pte_get_entry(caller, pgn);
+    if (PAGING_PAGE_PRESENT(pte) &&
+        !(pte & (PAGING_PTE_SWAPPED_MASK | PAGING_PTE_ZERO_MASK)) &&
+        PAGING_FPN(pte) == fpn)
     {
-      return -1;   // Không còn frame trống trong swap
+      pgn_list_remove(&mm->fifo_pgn, pgn);
+      *retpgn = pgn;
+      return 0;
     }
+  }
 
-    /* Bắt đầu cơ chế hoán trang (swap):
-       - Copy nội dung frame của victim từ RAM → SWAP
-       - Đánh dấu victim là 'bị swap'
-       - Tái sử dụng frame RAM của victim cho trang đang cần nạp
-    */
-    {
-      uint32_t vic_pte = pte_get_entry(caller, vicpgn);
-      addr_t vicfpn = PAGING_FPN(vic_pte);
-      struct memphy_struct *mram = caller->krnl->mram;
-      struct memphy_struct *mswp = caller->krnl->active_mswp;
-
-      /* Kiểm tra hợp lệ: victim phải đang có mặt trong RAM */
-      if (!PAGING_PAGE_PRESENT(vic_pte)) {
-        MEMPHY_put_freefp(mswp, swpfpn);
-        return -1;
-      }
+  return -1;
+}
 
-      /* Sao chép dữ liệu frame của victim từ RAM sang SWAP */
-      if (__swap_cp_page(mram, vicfpn, mswp, swpfpn) != 0) {
-        MEMPHY_put_freefp(mswp, swpfpn);
-        return -1;   // Lỗi copy
-      }
+/*pg_getpage - get the page in ram
+ *@mm: memory region
+ *@pagenum: PGN
+ *@framenum: return FPN
+ *@caller: caller
+ *@wr: the frame is going to be written
+ *
+ * A read of a page never written is served by the shared zero frame
+ * (MM_ZERO_PAGE), the page gets its own frame on the first write.
+ */
+int pg_getpage(struct mm_struct *mm, addr_t pgn, addr_t *fpn, struct pcb_t *caller,
+               int wr)
+{
+
+  uint32_t pte = pte_get_entry(caller, pgn);
+
+  /* Trang đang nằm trong RAM (present và không bị swap); trang trên
+     frame 0 dùng chung chỉ được đọc */
+  if (PAGING_PAGE_PRESENT(pte) && !(pte & PAGING_PTE_SWAPPED_MASK) &&
+      (!wr || !(pte & PAGING_PTE_ZERO_MASK)))
+  {
+    *fpn = PAGING_FPN(pte);
+    return 0;
+  }
+
+  addr_t tgtfpn;
+  struct memphy_struct *mram = caller->krnl->mram;
+
+#ifdef MM_ZERO_PAGE
+  if (!PAGING_PAGE_PRESENT(pte) && !wr && MEMPHY_zero_frame(mram, &tgtfpn) == 0)
+  {
+    pte_set_zero(caller, pgn, tgtfpn);
+    zero_stat.mapped++;
+    *fpn = tgtfpn;
+    return 0;
+  }
+#endif
 
-      /* Cập nhật PTE của victim:
-         - đặt trạng thái swapped
-         - lưu offset của frame trong swap
-      */
-      pte_set_swap(caller, vicpgn, 0, swpfpn);
-
-      /* Gán lại frame RAM của victim cho trang pgn đang cần */
-      if (pte_set_fpn(caller, pgn, vicfpn) != 0) {
-        /* Nếu gán frame lỗi → phục hồi lại PTE của victim */
-        pte_set_fpn(caller, vicpgn, vicfpn);
-        MEMPHY_put_freefp(mswp, swpfpn);
+  /* Ưu tiên lấy frame trống trong RAM, chỉ hoán trang khi RAM đã đầy */
+  if (MEMPHY_get_freefp(mram, &tgtfpn) != 0)
+  {
+    addr_t vicpgn;
+    uint32_t vic_pte;
+    int ret = 0;
+
+    do {
+      /* Tìm trang nạn nhân (victim page) còn nằm trong RAM,
+         bỏ qua các entry cũ trong FIFO của trang đã bị swap */
+      do {
+        if (find_victim_page(mm, &vicpgn) == -1 &&
+            find_victim_frame(caller, mm, &vicpgn) == -1)
+          return -1;   // Không tìm được victim page
+        vic_pte = pte_get_entry(caller, vicpgn);
+      } while (!PAGING_PAGE_PRESENT(vic_pte) ||
+               (vic_pte & (PAGING_PTE_SWAPPED_MASK | PAGING_PTE_ZERO_MASK)));
+
+      tgtfpn = PAGING_FPN(vic_pte);
+      /* Pool chỉ được giữ một frame victim mỗi lần, victim kế tiếp
+         phải giải phóng frame (pool còn chỗ hoặc ra thiết bị swap) */
+      ret = swap_out_page(caller, vicpgn, tgtfpn, ret != 1);
+      if (ret < 0)
+      {
+        enlist_pgn_node(&mm->fifo_pgn, vicpgn);
         return -1;
       }
+      /* ret == 1: frame của victim đã thành frame của pool nén,
+         cần thêm một victim nữa */
+    } while (ret == 1);
+  }
 
-      /* Ghi nhận trang pgn vừa được đưa vào RAM vào danh sách FIFO */
-      enlist_pgn_node(&mm->fifo_pgn, pgn);
+  if (PAGING_PAGE_PRESENT(pte) && (pte & PAGING_PTE_SWAPPED_MASK))
+  {
+    /* Trang đã bị swap → nạp lại nội dung và trả slot swap */
+    if (swap_in_page(caller, pte, tgtfpn) != 0)
+    {
+      MEMPHY_put_freefp(mram, tgtfpn);
+      return -1;
     }
   }
+  else
+  {
+    /* Trang chưa từng được dùng (hoặc lần ghi đầu lên frame 0 dùng
+       chung) → cấp frame đã xoá trắng */
+    MEMPHY_fill(mram, tgtfpn * PAGING_PAGESZ, 0, PAGING_PAGESZ);
+#ifdef MM_ZERO_PAGE
+    if (pte & PAGING_PTE_ZERO_MASK)
+      zero_stat.cow++;
+#endif
+  }
 
-  /* Trả về frame number đã map */
-  *fpn = PAGING_FPN(pte_get_entry(caller,pgn));
+  pte_set_fpn(caller, pgn, tgtfpn);
+  MEMPHY_set_owner(mram, tgtfpn, caller->pid);
+  MEMPHY_rmap_set(mram, tgtfpn, mm, pgn);
 
-  if (!PAGING_PAGE_PRESENT(pte_get_entry(caller,pgn))) {
-    return -1;
-  }
+  /* Ghi nhận trang pgn vừa được đưa vào RAM vào danh sách FIFO */
+  enlist_pgn_node(&mm->fifo_pgn, pgn);
 
+  *fpn = tgtfpn;
   return 0;
 }
 
+/*pg_getspan - resolve the page holding a virtual address once
+ *@mm: memory region
+ *@addr: virtual address to acess
+ *@len: number of bytes wanted from @addr
+ *@phyaddr: return physical address of @addr
+ *@spanlen: return number of bytes contiguous in the frame (<= @len)
+ *@wr: the span is going to be written
+ *
+ */
+static int pg_getspan(struct mm_struct *mm, addr_t addr, addr_t len,
+                      struct pcb_t *caller, addr_t *phyaddr, addr_t *spanlen,
+                      int wr)
+{
+  addr_t pgn = PAGING_PGN(addr);
+  addr_t off = PAGING_OFFST(addr);
+  addr_t fpn;
+
+  if (pg_getpage(mm, pgn, &fpn, caller, wr) != 0)
+    return -1;
+
+  *phyaddr = (fpn << PAGING_ADDR_FPN_LOBIT) + off;
+  *spanlen = PAGING_PAGESZ - off;
+  if (*spanlen > len)
+    *spanlen = len;
+
+  return 0;
+}
 
 /*pg_getval - read value at given offset
  *@mm: memory region
@@ -346,7 +787,7 @@ int pg_getval(struct mm_struct *mm, int addr, BYTE *data, struct pcb_t *caller)
   /* Đảm bảo trang pgn đã nằm trong RAM.
      Nếu trang bị swap-out → pg_getpage sẽ tự swap-in.
   */
-  if (pg_getpage(mm, pgn, &fpn, caller) != 0)
+  if (pg_getpage(mm, pgn, &fpn, caller, 0) != 0)
     return -1; /* truy cập trang lỗi hoặc không hợp lệ */
 
   /* Tính địa chỉ vật lý: physical address = frame number + offset */
@@ -374,7 +815,7 @@ int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller)
   addr_t fpn;
 
   /* Đảm bảo trang đã được nạp vào RAM (fault nếu cần) */
-  if (pg_getpage(mm, pgn, &fpn, caller) != 0)
+  if (pg_getpage(mm, pgn, &fpn, caller, 1) != 0)
     return -1; /* không thể truy cập trang */
 
   /* Tính địa chỉ vật lý trong RAM */
@@ -399,7 +840,7 @@ int __read(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE *data)
 {
   /* Validate inputs and region bounds under mutex */
   pthread_mutex_lock(&mmvm_lock);
-  struct vm_rg_struct *currg = get_symrg_byid(caller->krnl->mm, rgid);
+  struct vm_rg_struct *currg = get_symrg_byid(caller, rgid);
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->krnl->mm, vmaid);
 
   if (!currg || !cur_vma) {
@@ -461,7 +902,7 @@ int libread(
 int __write(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE value)
 {
   pthread_mutex_lock(&mmvm_lock);
-  struct vm_rg_struct *currg = get_symrg_byid(caller->krnl->mm, rgid);
+  struct vm_rg_struct *currg = get_symrg_byid(caller, rgid);
 
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->krnl->mm, vmaid);
 
@@ -508,6 +949,8 @@ int libwrite(
   pthread_mutex_lock(&mmvm_lock);
   print_pgtbl(proc, 0, -1); // print max TBL
   pthread_mutex_unlock(&mmvm_lock);
+#elif defined(MEMPHY_DUMP_PATH)
+  MEMPHY_dump_file(proc->krnl->mram, MEMPHY_DUMP_PATH);
 #else
   MEMPHY_dump(proc->krnl->mram);
 #endif
@@ -515,37 +958,445 @@ int libwrite(
   return val;
 }
 
-/*free_pcb_memphy - collect all memphy of pcb
+/*get_valid_rg - get a region which covers [offset, offset + size)
+ *@caller: caller
+ *@vmaid: ID vm area of the region
+ *@rgid: memory region ID
+ *@offset: start offset in region
+ *@size: number of bytes
+ *
+ * Must be called with mmvm_lock held, return NULL on invalid range
+ */
+static struct vm_rg_struct *get_valid_rg(struct pcb_t *caller, int vmaid, int rgid,
+                                         addr_t offset, addr_t size)
+{
+  struct vm_rg_struct *currg = get_symrg_byid(caller, rgid);
+  struct vm_area_struct *cur_vma = get_vma_by_num(caller->krnl->mm, vmaid);
+
+  if (currg == NULL || cur_vma == NULL)
+    return NULL;
+
+  if (currg->rg_start >= currg->rg_end)
+    return NULL;
+
+  if (offset + size > currg->rg_end - currg->rg_start || offset + size < offset)
+    return NULL;
+
+  return currg;
+}
+
+/*__memset - fill a range of region memory
  *@caller: caller
  *@vmaid: ID vm area to alloc memory region
- *@incpgnum: number of page
+ *@rgid: memory region ID (used to identify variable in symbole table)
+ *@offset: start offset in memory region
+ *@size: number of bytes
+ *@value: filled value
+ *
+ * Each page is resolved once and filled as a contiguous physical span
  */
-int free_pcb_memph(struct pcb_t *caller)
+int __memset(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, addr_t size, BYTE value)
 {
   pthread_mutex_lock(&mmvm_lock);
-  int pagenum, fpn;
-  uint32_t pte;
+  struct vm_rg_struct *currg = get_valid_rg(caller, vmaid, rgid, offset, size);
+  addr_t vaddr, phyaddr, span;
 
-  for (pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
+  if (currg == NULL)
   {
-    pte = caller->krnl->mm->pgd[pagenum];
+    pthread_mutex_unlock(&mmvm_lock);
+    return -1;
+  }
+
+  vaddr = currg->rg_start + offset;
+  while (size > 0)
+  {
+    if (pg_getspan(caller->krnl->mm, vaddr, size, caller, &phyaddr, &span, 1) != 0 ||
+        MEMPHY_fill(caller->krnl->mram, phyaddr, value, span) != 0)
+    {
+      pthread_mutex_unlock(&mmvm_lock);
+      return -1;
+    }
+    vaddr += span;
+    size -= span;
+  }
+
+  pthread_mutex_unlock(&mmvm_lock);
+  return 0;
+}
+
+/*__memxfer - walk two regions page by page for copy or compare
+ *@caller: caller
+ *@vmaid: ID vm area of both regions
+ *@srcid: source region ID
+ *@dstid: destination region ID
+ *@size: number of bytes
+ *@result: NULL to copy src to dst, otherwise return memcmp(src, dst)
+ *
+ * A chunk never crosses a page of either side. The source chunk is staged
+ * before the destination page is resolved since faulting the destination
+ * in may evict the source frame.
+ */
+static int __memxfer(struct pcb_t *caller, int vmaid, int srcid, int dstid,
+                     addr_t size, int *result)
+{
+  BYTE srcbuf[PAGING_PAGESZ];
+  BYTE dstbuf[PAGING_PAGESZ];
+  struct memphy_struct *mram = caller->krnl->mram;
+  struct mm_struct *mm = caller->krnl->mm;
+  struct vm_rg_struct *srcrg, *dstrg;
+  addr_t srcaddr, dstaddr, phyaddr, span, chunk;
+
+  pthread_mutex_lock(&mmvm_lock);
+  srcrg = get_valid_rg(caller, vmaid, srcid, 0, size);
+  dstrg = get_valid_rg(caller, vmaid, dstid, 0, size);
+  if (srcrg == NULL || dstrg == NULL)
+  {
+    pthread_mutex_unlock(&mmvm_lock);
+    return -1;
+  }
+
+  if (result)
+    *result = 0;
+
+  srcaddr = srcrg->rg_start;
+  dstaddr = dstrg->rg_start;
+  while (size > 0)
+  {
+    chunk = PAGING_PAGESZ - PAGING_OFFST(dstaddr);
+    if (chunk > size)
+      chunk = size;
+
+    if (pg_getspan(mm, srcaddr, chunk, caller, &phyaddr, &chunk, 0) != 0 ||
+        MEMPHY_read_block(mram, phyaddr, srcbuf, chunk) != 0 ||
+        pg_getspan(mm, dstaddr, chunk, caller, &phyaddr, &span,
+                   result == NULL) != 0)
+    {
+      pthread_mutex_unlock(&mmvm_lock);
+      return -1;
+    }
 
-    if (PAGING_PAGE_PRESENT(pte))
+    if (result == NULL)
     {
-      fpn = PAGING_FPN(pte);
-      MEMPHY_put_freefp(caller->krnl->mram, fpn);
+      if (MEMPHY_write_block(mram, phyaddr, srcbuf, chunk) != 0)
+      {
+        pthread_mutex_unlock(&mmvm_lock);
+        return -1;
+      }
     }
     else
     {
-      fpn = PAGING_SWP(pte);
-      MEMPHY_put_freefp(caller->krnl->active_mswp, fpn);
+      if (MEMPHY_read_block(mram, phyaddr, dstbuf, chunk) != 0)
+      {
+        pthread_mutex_unlock(&mmvm_lock);
+        return -1;
+      }
+      *result = memcmp(srcbuf, dstbuf, chunk);
+      if (*result != 0)
+        break;
     }
+
+    srcaddr += chunk;
+    dstaddr += chunk;
+    size -= chunk;
   }
 
   pthread_mutex_unlock(&mmvm_lock);
   return 0;
 }
 
+/*__memcpy - copy a range from a region to another region */
+int __memcpy(struct pcb_t *caller, int vmaid, int srcid, int dstid, addr_t size)
+{
+  return __memxfer(caller, vmaid, srcid, dstid, size, NULL);
+}
+
+/*__memcmp - compare a range of two regions */
+int __memcmp(struct pcb_t *caller, int vmaid, int srcid, int dstid, addr_t size, int *result)
+{
+  return __memxfer(caller, vmaid, srcid, dstid, size, result);
+}
+
+/*libmemset - PAGING-based fill a region memory */
+int libmemset(
+    struct pcb_t *proc,   // Process executing the instruction
+    uint32_t destination, // Index of destination register
+    addr_t offset,        // Start address = [destination] + [offset]
+    addr_t size,          // Number of bytes
+    BYTE value)           // Filled value
+{
+  int val = __memset(proc, 0, destination, offset, size, value);
+  if (val == -1)
+  {
+    return -1;
+  }
+  printf("libmemset:%d, PID: %i\n", __LINE__, proc->pid);
+#ifdef IODUMP
+#ifdef PAGETBL_DUMP
+  pthread_mutex_lock(&mmvm_lock);
+  print_pgtbl(proc, 0, -1); // print max TBL
+  pthread_mutex_unlock(&mmvm_lock);
+#endif
+#endif
+  return val;
+}
+
+/*libmemcpy - PAGING-based copy between two region memory */
+int libmemcpy(
+    struct pcb_t *proc,   // Process executing the instruction
+    uint32_t source,      // Index of source register
+    uint32_t destination, // Index of destination register
+    addr_t size)          // Number of bytes
+{
+  int val = __memcpy(proc, 0, source, destination, size);
+  if (val == -1)
+  {
+    return -1;
+  }
+  printf("libmemcpy:%d, PID: %i\n", __LINE__, proc->pid);
+#ifdef IODUMP
+#ifdef PAGETBL_DUMP
+  pthread_mutex_lock(&mmvm_lock);
+  print_pgtbl(proc, 0, -1); // print max TBL
+  pthread_mutex_unlock(&mmvm_lock);
+#endif
+#endif
+  return val;
+}
+
+/*libmemcmp - PAGING-based compare two region memory */
+int libmemcmp(
+    struct pcb_t *proc,   // Process executing the instruction
+    uint32_t source,      // Index of first register
+    uint32_t destination, // Index of second register
+    addr_t size)          // Number of bytes
+{
+  int result;
+  int val = __memcmp(proc, 0, source, destination, size, &result);
+  if (val == -1)
+  {
+    return -1;
+  }
+  printf("libmemcmp:%d, PID: %i, result: %d\n", __LINE__, proc->pid,
+         (result > 0) - (result < 0));
+  return val;
+}
+
+/*free_pcb_memphy - collect all memphy of pcb
+ *@caller: caller
+ *
+ * Called when the process exits: every region still in its symbol table
+ * goes back to the free region list and the pages left unused give their
+ * frames / swap slots back to MEMRAM / MEMSWP.
+ */
+int free_pcb_memph(struct pcb_t *caller)
+{
+  int rgid;
+
+  pthread_mutex_lock(&mmvm_lock);
+
+  for (rgid = 0; rgid < PAGING_MAX_SYMTBL_SZ; rgid++)
+  {
+    struct vm_rg_struct *rgnode = &caller->cold->symrgtbl[rgid];
+
+    if (rgnode->rg_start >= rgnode->rg_end)
+      continue;
+
+    enlist_vm_freerg_list(caller->krnl->mm,
+                          init_vm_rg(rgnode->rg_start, rgnode->rg_end));
+    pg_unref_range(caller, rgnode->rg_start, rgnode->rg_end);
+    rgnode->rg_start = rgnode->rg_end = 0;
+  }
+
+  pthread_mutex_unlock(&mmvm_lock);
+  return 0;
+}
+
+#ifdef MM_CODE_PAGING
+/*
+ * Per-CPU instruction TLB: direct mapped PGN -> FPN cache of the code
+ * pages. Each CPU is a thread, so the TLB is thread local. It is tagged
+ * with mm->tlb_gen and flushed as soon as a translation was removed.
+ */
+struct itlb_entry {
+  addr_t pgn;
+  addr_t fpn;
+  int valid;
+};
+
+static __thread struct {
+  struct itlb_entry ent[ITLB_ENTRIES];
+  struct mm_struct *mm;
+  uint32_t gen;
+  uint64_t hit;
+  uint64_t miss;
+} itlb;
+
+static void itlb_sync(struct mm_struct *mm, uint32_t gen)
+{
+  if (itlb.mm == mm && itlb.gen == gen)
+    return;
+  memset(itlb.ent, 0, sizeof(itlb.ent));
+  itlb.mm = mm;
+  itlb.gen = gen;
+}
+
+/*code_map - load the text of a code segment into the code VMA
+ *@caller: caller
+ *@code: code segment
+ *
+ * Segments are shared by the processes running the same program, the
+ * text is mapped once and given back by free_code_memph when its last
+ * user exits. Caller holds mmvm_lock.
+ */
+static int code_map(struct pcb_t *caller, struct code_seg_t *code)
+{
+  struct mm_struct *mm = caller->krnl->mm;
+  struct vm_area_struct *vma = get_vma_by_num(mm, PAGING_CODE_VMAID);
+  struct vm_rg_struct rgnode;
+  addr_t off, phyaddr, span;
+
+  if (vma == NULL || vma->vm_id != PAGING_CODE_VMAID || code->size == 0)
+    return -1;
+
+  if (get_free_vmrg_area(caller, PAGING_CODE_VMAID, code->size, &rgnode) != 0)
+  {
+    /* Grow the code VMA, its pages are faulted in by the copy below */
+    if (vma->sbrk + code->size > PAGING_CODE_VMA_END)
+      return -1;
+    rgnode.rg_start = vma->sbrk;
+    rgnode.rg_end = vma->sbrk + code->size;
+    vma->sbrk = rgnode.rg_end;
+    if (vma->vm_end < vma->sbrk)
+      vma->vm_end = PAGING_PAGE_ALIGNSZ(vma->sbrk);
+  }
+  pg_ref_range(mm, rgnode.rg_start, rgnode.rg_end);
+
+  for (off = 0; off < code->size; off += span)
+  {
+    if (pg_getspan(mm, rgnode.rg_start + off, code->size - off, caller,
+                   &phyaddr, &span, 1) != 0 ||
+        MEMPHY_write_block(caller->krnl->mram, phyaddr,
+                           (BYTE *)code->text + off, span) != 0)
+    {
+      pg_unref_range(caller, rgnode.rg_start, rgnode.rg_end);
+      enlist_vma_freerg(vma, init_vm_rg(rgnode.rg_start, rgnode.rg_end));
+      return -1;
+    }
+  }
+
+  __atomic_store_n(&code->vbase, rgnode.rg_start, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/*libfetch - read instruction bytes through the MMU
+ *@proc: process executing the instruction
+ *@pc: offset of the first byte in the code segment
+ *@buf: destination buffer
+ *@len: number of bytes wanted
+ *
+ * Like a fetch unit, one call reads a single page: the copy stops at the
+ * end of the page (or of the text). Return the number of bytes read.
+ *
+ * Translations hit in the per-CPU i-TLB are read without mmvm_lock: the
+ * generation is checked again after the copy and the page is walked
+ * again if a translation was removed meanwhile (its frame may have been
+ * reused). Misses walk the page table and fault the page in under the
+ * lock, like any other access.
+ */
+int libfetch(struct pcb_t *proc, uint32_t pc, uint8_t *buf, uint32_t len)
+{
+  struct code_seg_t *code = proc->code;
+  struct mm_struct *mm = proc->krnl->mm;
+  struct memphy_struct *mram = proc->krnl->mram;
+  addr_t addr, pgn, off, fpn, span;
+  struct itlb_entry *e;
+  uint32_t gen;
+
+  if (pc >= code->size)
+    return -1;
+
+  if (__atomic_load_n(&code->vbase, __ATOMIC_ACQUIRE) == 0)
+  {
+    pthread_mutex_lock(&mmvm_lock);
+    if (code->vbase == 0 && code_map(proc, code) != 0)
+    {
+      pthread_mutex_unlock(&mmvm_lock);
+      return -1;
+    }
+    pthread_mutex_unlock(&mmvm_lock);
+  }
+
+  addr = code->vbase + pc;
+  pgn = PAGING_PGN(addr);
+  off = PAGING_OFFST(addr);
+  span = PAGING_PAGESZ - off;
+  if (span > len)
+    span = len;
+  if (span > code->size - pc)
+    span = code->size - pc;
+  e = &itlb.ent[pgn & (ITLB_ENTRIES - 1)];
+
+  gen = __atomic_load_n(&mm->tlb_gen, __ATOMIC_ACQUIRE);
+  itlb_sync(mm, gen);
+  if (e->valid && e->pgn == pgn)
+  {
+    MEMPHY_read_block(mram, (e->fpn << PAGING_ADDR_FPN_LOBIT) + off,
+                      (BYTE *)buf, span);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&mm->tlb_gen, __ATOMIC_RELAXED) == gen)
+    {
+      itlb.hit++;
+      return span;
+    }
+    /* Bản dịch vừa bị huỷ trong lúc đọc → đọc lại qua page table */
+  }
+
+  itlb.miss++;
+  pthread_mutex_lock(&mmvm_lock);
+  if (pg_getpage(mm, pgn, &fpn, proc, 0) != 0)
+  {
+    pthread_mutex_unlock(&mmvm_lock);
+    return -1;
+  }
+  MEMPHY_read_block(mram, (fpn << PAGING_ADDR_FPN_LOBIT) + off,
+                    (BYTE *)buf, span);
+  /* The fault may itself have evicted pages, resync before filling */
+  itlb_sync(mm, mm->tlb_gen);
+  pthread_mutex_unlock(&mmvm_lock);
+
+  e->pgn = pgn;
+  e->fpn = fpn;
+  e->valid = 1;
+  return span;
+}
+
+/*libitlb_stats - i-TLB hits and misses of the calling CPU */
+void libitlb_stats(uint64_t *hit, uint64_t *miss)
+{
+  *hit = itlb.hit;
+  *miss = itlb.miss;
+}
+
+/*free_code_memph - give back the code VMA region of a code segment
+ *@caller: caller
+ *@code: code segment whose last user exits
+ */
+int free_code_memph(struct pcb_t *caller, struct code_seg_t *code)
+{
+  struct vm_area_struct *vma;
+
+  pthread_mutex_lock(&mmvm_lock);
+  if (code->vbase != 0)
+  {
+    vma = get_vma_by_num(caller->krnl->mm, PAGING_CODE_VMAID);
+    pg_unref_range(caller, code->vbase, code->vbase + code->size);
+    enlist_vma_freerg(vma, init_vm_rg(code->vbase, code->vbase + code->size));
+    code->vbase = 0;
+  }
+  pthread_mutex_unlock(&mmvm_lock);
+  return 0;
+}
+#endif
 
 /*find_victim_page - find victim page
  *@caller: caller
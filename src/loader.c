@@ -1,9 +1,14 @@
 #include "loader.h"
+#include "inst.h"
+#ifdef MM_CODE_PAGING
+#include "mm.h"
+#endif
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static uint32_t avail_pid = 1; 
+static uint32_t avail_pid = 1;
 /* Biến PID toàn cục – mỗi lần load process mới thì tăng lên */
 
 #define OPT_CALC    "calc"
@@ -12,6 +17,87 @@ static uint32_t avail_pid = 1;
 #define OPT_READ    "read"
 #define OPT_WRITE   "write"
 #define OPT_SYSCALL "syscall"
+#define OPT_MEMSET  "memset"
+#define OPT_MEMCPY  "memcpy"
+#define OPT_MEMCMP  "memcmp"
+
+/* -------------------------------------------------------
+   Cache code segment dùng chung giữa các process.
+   Key là đường dẫn file chương trình; mỗi chương trình chỉ
+   được đọc và parse một lần, các PCB cùng chương trình dùng
+   chung một code_seg_t (chỉ đọc) và tăng/giảm code->ref.
+   ------------------------------------------------------- */
+struct code_cache_t {
+    char * path;                 // đường dẫn file (key)
+    uint32_t priority;           // priority đọc từ dòng đầu file
+    struct code_seg_t * code;    // code segment dùng chung
+    struct code_cache_t * next;
+};
+
+static struct code_cache_t * code_cache = NULL;
+static pthread_mutex_t code_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* -------------------------------------------------------
+   Slab cho các đối tượng kích thước cố định (PCB, code segment).
+   Đối tượng được cấp theo lô LD_SLAB_OBJS phần tử và không bao
+   giờ trả lại cho hệ thống: khi process kết thúc, đối tượng quay
+   về free list của slab để process sau dùng lại, nhờ vậy bộ nhớ
+   không tăng dần khi process liên tục được nạp và kết thúc.
+   ------------------------------------------------------- */
+struct slab_t {
+    size_t objsz;                // kích thước một đối tượng
+    size_t align;                // căn lề của đối tượng (luỹ thừa của 2)
+    void * free;                 // free list, liên kết qua word đầu
+    pthread_mutex_t lock;
+};
+
+/* Phần cold của PCB và bảng trang legacy nằm chung một đối tượng */
+struct pcb_cold_obj_t {
+    struct pcb_cold_t cold;
+    struct page_table_t page_table;
+};
+
+/* Phần hot của PCB căn theo cache line để không dùng chung line
+ * với PCB khác */
+static struct slab_t pcb_slab = {
+    sizeof(struct pcb_t), 64, NULL, PTHREAD_MUTEX_INITIALIZER
+};
+static struct slab_t pcb_cold_slab = {
+    sizeof(struct pcb_cold_obj_t), sizeof(void*), NULL, PTHREAD_MUTEX_INITIALIZER
+};
+static struct slab_t code_slab = {
+    sizeof(struct code_seg_t), sizeof(void*), NULL, PTHREAD_MUTEX_INITIALIZER
+};
+
+static void * slab_alloc(struct slab_t * slab) {
+    void * obj;
+
+    pthread_mutex_lock(&slab->lock);
+    if (slab->free == NULL) {
+        /* Hết đối tượng rỗi → cấp thêm một lô mới */
+        size_t sz = (slab->objsz + slab->align - 1) & ~(slab->align - 1);
+        char * chunk = (char*)aligned_alloc(slab->align, sz * LD_SLAB_OBJS);
+        int i;
+
+        for (i = LD_SLAB_OBJS - 1; i >= 0; i--) {
+            *(void**)(chunk + i * sz) = slab->free;
+            slab->free = chunk + i * sz;
+        }
+    }
+    obj = slab->free;
+    slab->free = *(void**)obj;
+    pthread_mutex_unlock(&slab->lock);
+
+    memset(obj, 0, slab->objsz);
+    return obj;
+}
+
+static void slab_free(struct slab_t * slab, void * obj) {
+    pthread_mutex_lock(&slab->lock);
+    *(void**)obj = slab->free;
+    slab->free = obj;
+    pthread_mutex_unlock(&slab->lock);
+}
 
 /* -------------------------------------------------------
    Chuyển chuỗi opcode (ví dụ: "alloc") thành enum opcode
@@ -29,6 +115,12 @@ static enum ins_opcode_t get_opcode(char * opt) {
         return WRITE;
     }else if (!strcmp(opt, OPT_SYSCALL)) {
         return SYSCALL;
+    }else if (!strcmp(opt, OPT_MEMSET)) {
+        return MEMSET;
+    }else if (!strcmp(opt, OPT_MEMCPY)) {
+        return MEMCPY;
+    }else if (!strcmp(opt, OPT_MEMCMP)) {
+        return MEMCMP;
     }else{
         // Nếu opcode không hợp lệ → báo lỗi và dừng lại
         printf("get_opcode return Opcode: %s\n", opt);
@@ -37,21 +129,11 @@ static enum ins_opcode_t get_opcode(char * opt) {
 }
 
 /* -------------------------------------------------------
-   Hàm load(): Đọc file mô tả tiến trình và tạo PCB tương ứng
+   parse_code(): Đọc file mô tả tiến trình thành code segment
+   @path:     đường dẫn file chương trình
+   @priority: trả về priority ghi ở dòng đầu file
    ------------------------------------------------------- */
-struct pcb_t * load(const char * path) {
-
-    /* Tạo PCB mới cho process */
-    struct pcb_t * proc = (struct pcb_t *)malloc(sizeof(struct pcb_t));
-
-    proc->pid = avail_pid;     // Gán PID
-    avail_pid++;               // Tăng PID cho process tiếp theo
-
-    proc->page_table =
-        (struct page_table_t*)malloc(sizeof(struct page_table_t));
-
-    proc->bp = PAGE_SIZE;      // Base pointer ban đầu
-    proc->pc = 0;              // Program counter bắt đầu từ 0
+static struct code_seg_t * parse_code(const char * path, uint32_t * priority) {
 
     /* Mở file mô tả tiến trình */
     FILE * file;
@@ -60,36 +142,43 @@ struct pcb_t * load(const char * path) {
         exit(1);
     }
 
-    /* Lưu đường dẫn file vào PCB */
-    snprintf(proc->path, 2*sizeof(path)+1, "%s", path);
-
     /* Chuẩn bị load code segment */
     char opcode[10];
-    proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
+    struct code_seg_t * code = (struct code_seg_t*)slab_alloc(&code_slab);
 
     /* Đọc dòng đầu tiên: priority + số instruction */
-    fscanf(file, "%u %u", &proc->priority, &proc->code->size);
+    uint32_t ninst = 0;
+    fscanf(file, "%u %u", priority, &ninst);
 
-    /* Cấp bộ nhớ cho mảng instruction */
-    proc->code->text = (struct inst_t*)malloc(
-        sizeof(struct inst_t) * proc->code->size
+    /* Mảng instruction ở dạng giải mã, mã hoá gọn ở cuối hàm */
+    struct inst_t * insts = (struct inst_t*)calloc(
+        ninst ? ninst : 1, sizeof(struct inst_t)
     );
 
-    uint32_t i = 0;
+    uint32_t n = 0;            // số lệnh sau khi gộp CALC
+    uint32_t k, i = 0;
     char buf[200];
 
     /* --------------------------------------------
        Đọc lần lượt từng instruction trong file
        -------------------------------------------- */
-    for (i = 0; i < proc->code->size; i++) {
+    for (k = 0; k < ninst; k++) {
 
         fscanf(file, "%s", opcode);                // đọc opcode dạng text
-        proc->code->text[i].opcode = get_opcode(opcode);   // chuyển sang enum
+        i = n++;
+        insts[i].opcode = get_opcode(opcode);   // chuyển sang enum
 
-        switch(proc->code->text[i].opcode) {
+        switch(insts[i].opcode) {
 
         case CALC:
-            // CALC không có tham số nên không đọc gì thêm
+            // CALC không có tham số; các CALC liên tiếp được gộp thành
+            // một lệnh CALC-N với arg_0 = N
+            if (i > 0 && insts[i - 1].opcode == CALC) {
+                insts[i - 1].arg_0++;
+                n--;
+            } else {
+                insts[i].arg_0 = 1;
+            }
             break;
 
         case ALLOC:
@@ -97,36 +186,50 @@ struct pcb_t * load(const char * path) {
             fscanf(
                 file,
                 "" FORMAT_ARG " " FORMAT_ARG "\n",
-                &proc->code->text[i].arg_0,
-                &proc->code->text[i].arg_1
+                &insts[i].arg_0,
+                &insts[i].arg_1
             );
             break;
 
         case FREE:
             // FREE a  → chỉ có 1 tham số
-            fscanf(file, "" FORMAT_ARG "\n", &proc->code->text[i].arg_0);
+            fscanf(file, "" FORMAT_ARG "\n", &insts[i].arg_0);
             break;
 
         case READ:
         case WRITE:
-            // READ / WRITE có 3 tham số
+        case MEMCPY:
+        case MEMCMP:
+            // READ / WRITE / MEMCPY / MEMCMP có 3 tham số
             fscanf(
                 file,
                 "" FORMAT_ARG " " FORMAT_ARG " " FORMAT_ARG "\n",
-                &proc->code->text[i].arg_0,
-                &proc->code->text[i].arg_1,
-                &proc->code->text[i].arg_2
+                &insts[i].arg_0,
+                &insts[i].arg_1,
+                &insts[i].arg_2
+            );
+            break;
+
+        case MEMSET:
+            // MEMSET reg offset size value → 4 tham số
+            fscanf(
+                file,
+                "" FORMAT_ARG " " FORMAT_ARG " " FORMAT_ARG " " FORMAT_ARG "\n",
+                &insts[i].arg_0,
+                &insts[i].arg_1,
+                &insts[i].arg_2,
+                &insts[i].arg_3
             );
-            break;    
+            break;
 
         case SYSCALL:
             /* SYSCALL có thể nhiều tham số → dùng fgets + sscanf */
             fgets(buf, sizeof(buf), file);
             sscanf(buf, "" FORMAT_ARG "" FORMAT_ARG "" FORMAT_ARG "" FORMAT_ARG "",
-                       &proc->code->text[i].arg_0,
-                       &proc->code->text[i].arg_1,
-                       &proc->code->text[i].arg_2,
-                       &proc->code->text[i].arg_3
+                       &insts[i].arg_0,
+                       &insts[i].arg_1,
+                       &insts[i].arg_2,
+                       &insts[i].arg_3
             );
             break;
 
@@ -136,5 +239,180 @@ struct pcb_t * load(const char * path) {
         }
     }
 
+    fclose(file);
+
+    /* Mã hoá gọn: opcode 1 byte + operand dạng varint (xem inst.h) */
+    uint8_t enc[INST_MAX_LEN];
+    uint32_t nbytes = 0;
+
+    for (i = 0; i < n; i++)
+        nbytes += inst_encode(enc, &insts[i]);
+
+    code->text = (uint8_t*)malloc(nbytes ? nbytes : 1);
+    code->size = 0;
+    for (i = 0; i < n; i++)
+        code->size += inst_encode(code->text + code->size, &insts[i]);
+
+#ifndef MM_CODE_PAGING
+    /* Giải mã text một lần cho cả cache: run() lấy lệnh từ mảng này,
+       không phải giải mã varint ở mỗi lệnh */
+    code->insts = insts;
+    code->len = (uint8_t*)malloc(n ? n : 1);
+    for (i = 0, k = 0; i < n; i++) {
+        code->len[i] = inst_decode(code->text + k, &insts[i]);
+        k += code->len[i];
+    }
+#else
+    free(insts);
+#endif
+    return code;
+}
+
+/* -------------------------------------------------------
+   get_code(): Lấy code segment của chương trình tại @path
+   từ cache (parse file nếu chưa có) và tăng reference count.
+   Việc parse được thực hiện ngoài lock để các loader khác
+   không phải chờ; nếu có loader khác chèn cùng path trước
+   thì bản vừa parse được bỏ đi.
+   ------------------------------------------------------- */
+static struct code_seg_t * get_code(const char * path, uint32_t * priority) {
+    struct code_cache_t * it;
+
+    pthread_mutex_lock(&code_cache_lock);
+    for (it = code_cache; it != NULL; it = it->next) {
+        if (!strcmp(it->path, path)) {
+            it->code->ref++;
+            *priority = it->priority;
+            pthread_mutex_unlock(&code_cache_lock);
+            return it->code;
+        }
+    }
+    pthread_mutex_unlock(&code_cache_lock);
+
+    /* Cache miss → đọc file */
+    uint32_t prio;
+    struct code_seg_t * code = parse_code(path, &prio);
+
+    pthread_mutex_lock(&code_cache_lock);
+    for (it = code_cache; it != NULL; it = it->next) {
+        if (!strcmp(it->path, path))
+            break;
+    }
+    if (it != NULL) {
+        /* Loader khác đã chèn trước → dùng bản trong cache */
+        free(code->text);
+#ifndef MM_CODE_PAGING
+        free(code->insts);
+        free(code->len);
+#endif
+        slab_free(&code_slab, code);
+    } else {
+        it = (struct code_cache_t *)malloc(sizeof(struct code_cache_t));
+        it->path = strdup(path);
+        it->priority = prio;
+        it->code = code;
+        it->next = code_cache;
+        code_cache = it;
+    }
+    it->code->ref++;
+    *priority = it->priority;
+    pthread_mutex_unlock(&code_cache_lock);
+
+    return it->code;
+}
+
+/* -------------------------------------------------------
+   put_code(): Giảm reference count của @code, giải phóng
+   code segment và entry trong cache khi không còn PCB nào dùng
+   (@proc là process vừa kết thúc, dùng để trả vùng code VMA)
+   ------------------------------------------------------- */
+static void put_code(struct pcb_t * proc, struct code_seg_t * code) {
+    struct code_cache_t ** pit;
+
+    pthread_mutex_lock(&code_cache_lock);
+    if (--code->ref > 0) {
+        pthread_mutex_unlock(&code_cache_lock);
+        return;
+    }
+
+    for (pit = &code_cache; *pit != NULL; pit = &(*pit)->next) {
+        if ((*pit)->code == code) {
+            struct code_cache_t * victim = *pit;
+            *pit = victim->next;
+            free(victim->path);
+            free(victim);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&code_cache_lock);
+
+#ifdef MM_CODE_PAGING
+    free_code_memph(proc, code);    // trả text trong code VMA
+#endif
+    free(code->text);
+#ifndef MM_CODE_PAGING
+    free(code->insts);
+    free(code->len);
+#endif
+    slab_free(&code_slab, code);
+}
+
+/* -------------------------------------------------------
+   Hàm load_image(): Đọc file mô tả tiến trình và tạo PCB
+   tương ứng nhưng chưa gán PID. Được các worker prefetch gọi
+   trước thời điểm start_time của process.
+   ------------------------------------------------------- */
+struct pcb_t * load_image(const char * path) {
+
+    /* Tạo PCB mới cho process (lấy từ slab, đã xoá trắng):
+       phần hot và phần cold được cấp riêng */
+    struct pcb_t * proc = (struct pcb_t *)slab_alloc(&pcb_slab);
+    struct pcb_cold_obj_t * cobj =
+        (struct pcb_cold_obj_t *)slab_alloc(&pcb_cold_slab);
+
+    proc->cold = &cobj->cold;
+    proc->pid = 0;             // PID được gán khi admit (assign_pid)
+
+    proc->cold->page_table = &cobj->page_table;
+
+    proc->cold->bp = PAGE_SIZE; // Base pointer ban đầu
+    proc->pc = 0;              // Program counter bắt đầu từ 0
+    proc->calc_done = 0;
+    proc->ip = 0;
+
+    /* Lưu đường dẫn file vào PCB */
+    snprintf(proc->cold->path, sizeof(proc->cold->path), "%s", path);
+
+    /* Code segment lấy từ cache dùng chung */
+    proc->code = get_code(path, &proc->priority);
+
     return proc;
 }
+
+/* -------------------------------------------------------
+   Hàm assign_pid(): Gán PID tiếp theo cho process lúc admit
+   ------------------------------------------------------- */
+void assign_pid(struct pcb_t * proc) {
+    proc->pid = avail_pid;     // Gán PID
+    avail_pid++;               // Tăng PID cho process tiếp theo
+}
+
+/* -------------------------------------------------------
+   Hàm load(): Đọc file mô tả tiến trình và tạo PCB tương ứng
+   ------------------------------------------------------- */
+struct pcb_t * load(const char * path) {
+    struct pcb_t * proc = load_image(path);
+
+    assign_pid(proc);
+    return proc;
+}
+
+/* -------------------------------------------------------
+   Hàm unload(): Trả PCB về slab khi process kết thúc,
+   trả lại code segment dùng chung cho cache
+   ------------------------------------------------------- */
+void unload(struct pcb_t * proc) {
+    put_code(proc, proc->code);
+    slab_free(&pcb_cold_slab, proc->cold);  // cold là thành viên đầu của pcb_cold_obj_t
+    slab_free(&pcb_slab, proc);
+}
@@ -0,0 +1,445 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+/*
+ * PAGING based Memory Management
+ * Compressed swap tier mm/mm-zswap.c
+ *
+ * Swapped out pages are first compressed into a pool of MEMRAM frames
+ * (at most ZSWAP_POOL_SZ bytes and ZSWAP_MAX_PCT percent of MEMRAM), a
+ * page goes to the MEMSWP device only when the pool cannot get room or
+ * the page does not compress well. A pool entry is named by a handle
+ * that is stored as the swap offset of the PTE, with PAGING_SWPTYP_ZSWAP
+ * as swap type.
+ *
+ * Callers serialize through mmvm_lock (libmem.c).
+ */
+
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef MM_ZSWAP
+
+/*
+ * LZ codec on bytes (BYTE is signed), a stream of tokens:
+ *   0lllllll               literal run of l + 1 bytes that follow
+ *   1lllllll oooooooo      copy l + 3 bytes from o + 1 bytes back
+ */
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (0x7F + LZ_MIN_MATCH)
+#define LZ_MAX_LIT   0x80
+#define LZ_MAX_DIST  0x100
+#define LZ_HASH_BITS 8
+
+#define LZ_HASH(p) \
+  ((((uint32_t)(p)[0] << 16 | (uint32_t)(p)[1] << 8 | (p)[2]) * 2654435761u) \
+   >> (32 - LZ_HASH_BITS))
+
+static int lz_put_literals(const uint8_t *src, int len, uint8_t *out, int op, int cap)
+{
+  int run;
+
+  while (len > 0)
+  {
+    run = (len < LZ_MAX_LIT) ? len : LZ_MAX_LIT;
+    if (op + 1 + run > cap)
+      return -1;
+    out[op++] = run - 1;
+    memcpy(out + op, src, run);
+    op += run;
+    src += run;
+    len -= run;
+  }
+
+  return op;
+}
+
+/* Return the compressed size, -1 when it would exceed @cap */
+static int lz_compress(const uint8_t *in, int n, uint8_t *out, int cap)
+{
+  int head[1 << LZ_HASH_BITS];
+  int ip = 0, lit = 0, op = 0, cand, len, k;
+  uint32_t h;
+
+  memset(head, -1, sizeof(head));
+
+  while (ip + LZ_MIN_MATCH <= n)
+  {
+    h = LZ_HASH(in + ip);
+    cand = head[h];
+    head[h] = ip;
+
+    if (cand < 0 || ip - cand > LZ_MAX_DIST ||
+        memcmp(in + cand, in + ip, LZ_MIN_MATCH) != 0)
+    {
+      ip++;
+      continue;
+    }
+
+    len = LZ_MIN_MATCH;
+    while (ip + len < n && len < LZ_MAX_MATCH && in[cand + len] == in[ip + len])
+      len++;
+
+    op = lz_put_literals(in + lit, ip - lit, out, op, cap);
+    if (op < 0 || op + 2 > cap)
+      return -1;
+    out[op++] = 0x80 | (len - LZ_MIN_MATCH);
+    out[op++] = ip - cand - 1;
+
+    for (k = 1; k < len && ip + k + LZ_MIN_MATCH <= n; k++)
+      head[LZ_HASH(in + ip + k)] = ip + k;
+    ip += len;
+    lit = ip;
+  }
+
+  return lz_put_literals(in + lit, n - lit, out, op, cap);
+}
+
+/* Return 0 when @in decodes to exactly @n bytes */
+static int lz_decompress(const uint8_t *in, int len, uint8_t *out, int n)
+{
+  int ip = 0, op = 0, cnt, dist;
+
+  while (ip < len)
+  {
+    if (in[ip] & 0x80)
+    {
+      if (ip + 2 > len)
+        return -1;
+      cnt = (in[ip] & 0x7F) + LZ_MIN_MATCH;
+      dist = in[ip + 1] + 1;
+      ip += 2;
+      if (dist > op || op + cnt > n)
+        return -1;
+      for (; cnt > 0; cnt--, op++)   // có thể chồng lấn (dist < cnt)
+        out[op] = out[op - dist];
+    }
+    else
+    {
+      cnt = in[ip++] + 1;
+      if (ip + cnt > len || op + cnt > n)
+        return -1;
+      memcpy(out + op, in + ip, cnt);
+      ip += cnt;
+      op += cnt;
+    }
+  }
+
+  return (op == n) ? 0 : -1;
+}
+
+/*
+ * The pool lives in MEMRAM frames taken from the device as it grows, at
+ * most ZSWAP_POOL_SZ bytes and ZSWAP_MAX_PCT percent of the device, and
+ * given back once empty. A frame
+ * holds up to two compressed pages (zbud): side 0 from the start of the
+ * frame, side 1 ending at its last byte.
+ */
+struct zswap_frame {
+  addr_t fpn;
+  uint16_t len[2];    /* bytes of each side, 0 when the side is free */
+  int used;
+};
+
+/* Pool entry, frm < 0 marks a free handle */
+struct zswap_entry {
+  int frm;
+  int side;
+};
+
+static struct memphy_struct *zs_mram;
+static struct zswap_frame *zs_frm;
+static int zs_maxfrm;           /* frames the pool may hold */
+static int zs_nfrm;             /* frames held now */
+
+static struct zswap_entry *zs_tbl;
+static addr_t zs_cap;           /* entries in zs_tbl */
+static addr_t *zs_freeh;        /* stack of free handles */
+static addr_t zs_nfree;
+static addr_t zs_next;          /* first handle never used */
+static addr_t zs_used;          /* compressed bytes in the pool */
+
+static struct {
+  uint64_t stored;
+  uint64_t rej_full;
+  uint64_t rej_poor;
+  uint64_t loaded;
+  uint64_t dev_out;
+  uint64_t dev_in;
+  uint64_t raw_bytes;
+  uint64_t comp_bytes;
+} zs_stat;
+
+/*
+ * zswap_init - set up an empty pool
+ * @mram: device the pool frames are taken from
+ * @pool_sz: upper bound of the pool frames, in bytes
+ */
+int zswap_init(struct memphy_struct *mram, addr_t pool_sz)
+{
+  addr_t maxfrm = pool_sz / PAGING_PAGESZ;
+
+  /* Pool frames are RAM the processes no longer get, keep most of it */
+  if (maxfrm > mram->fp_num * ZSWAP_MAX_PCT / 100)
+    maxfrm = mram->fp_num * ZSWAP_MAX_PCT / 100;
+
+  zs_mram = mram;
+  zs_maxfrm = maxfrm;
+  zs_nfrm = 0;
+  zs_frm = calloc(zs_maxfrm ? zs_maxfrm : 1, sizeof(*zs_frm));
+  zs_used = 0;
+  zs_cap = 0;
+  zs_next = 0;
+  zs_nfree = 0;
+  zs_tbl = NULL;
+  zs_freeh = NULL;
+  memset(&zs_stat, 0, sizeof(zs_stat));
+  return (zs_frm == NULL) ? -1 : 0;
+}
+
+static int zswap_new_handle(addr_t *handle)
+{
+  struct zswap_entry *tbl;
+  addr_t *freeh, cap;
+
+  if (zs_nfree > 0)
+  {
+    *handle = zs_freeh[--zs_nfree];
+    return 0;
+  }
+
+  if (zs_next == zs_cap)
+  {
+    cap = zs_cap ? zs_cap * 2 : 64;
+    if (cap > PAGING_PTE_SWPOFF_MASK >> PAGING_PTE_SWPOFF_LOBIT)
+      cap = (PAGING_PTE_SWPOFF_MASK >> PAGING_PTE_SWPOFF_LOBIT) + 1;
+    if (cap == zs_cap)
+      return -1;   // hết handle mã hoá được trong PTE
+
+    tbl = realloc(zs_tbl, cap * sizeof(*tbl));
+    if (tbl == NULL)
+      return -1;
+    zs_tbl = tbl;
+    freeh = realloc(zs_freeh, cap * sizeof(*freeh));
+    if (freeh == NULL)
+      return -1;
+    zs_freeh = freeh;
+    zs_cap = cap;
+  }
+
+  *handle = zs_next++;
+  return 0;
+}
+
+/* Pick a frame side for @len bytes: a free side of a pool frame whose
+ * other side leaves room, else a new frame from MEMRAM, else @spare
+ * when a second page can still share it. Return 1 when @spare was taken */
+static int zswap_place(int len, int *frm, int *side, const addr_t *spare)
+{
+  int i, s, unused = -1, ret;
+
+  for (i = 0; i < zs_maxfrm; i++)
+  {
+    if (!zs_frm[i].used)
+    {
+      if (unused < 0)
+        unused = i;
+      continue;
+    }
+    for (s = 0; s < 2; s++)
+    {
+      if (zs_frm[i].len[s] == 0 && zs_frm[i].len[!s] + len <= PAGING_PAGESZ)
+      {
+        *frm = i;
+        *side = s;
+        return 0;
+      }
+    }
+  }
+
+  /* Pool frames are simulated RAM: no free frame, no pool growth */
+  if (unused < 0)
+    return -1;
+  if (MEMPHY_get_freefp(zs_mram, &zs_frm[unused].fpn) == 0)
+    ret = 0;
+  else if (spare != NULL && len <= PAGING_PAGESZ / 2)
+  {
+    zs_frm[unused].fpn = *spare;
+    ret = 1;
+  }
+  else
+    return -1;
+
+  zs_frm[unused].used = 1;
+  zs_frm[unused].len[0] = zs_frm[unused].len[1] = 0;
+  zs_nfrm++;
+  *frm = unused;
+  *side = 0;
+  return ret;
+}
+
+static addr_t zswap_addr(int frm, int side)
+{
+  addr_t base = zs_frm[frm].fpn * PAGING_PAGESZ;
+
+  return side ? base + PAGING_PAGESZ - zs_frm[frm].len[1] : base;
+}
+
+/*
+ * zswap_store - compress a page into the pool
+ * @page: PAGING_PAGESZ bytes
+ * @handle: pool handle of the stored page (out)
+ * @spare: MEMRAM frame the pool may take when it has to grow and no
+ *         frame is free, e.g. the frame of the page itself, or NULL.
+ *         It is taken only for a page of at most half a frame
+ *
+ * Return -1 when the page must go to the swap device instead, 1 when
+ * the pool took @spare.
+ */
+int zswap_store(const BYTE *page, addr_t *handle, const addr_t *spare)
+{
+  uint8_t buf[PAGING_PAGESZ];
+  int len, frm, side, ret;
+  addr_t h;
+
+  len = lz_compress((const uint8_t *)page, PAGING_PAGESZ, buf, ZSWAP_MAX_COMP);
+  if (len < 0)
+  {
+    zs_stat.rej_poor++;
+    return -1;
+  }
+
+  if ((ret = zswap_place(len, &frm, &side, spare)) < 0)
+  {
+    zs_stat.rej_full++;
+    return -1;
+  }
+  if (zswap_new_handle(&h) != 0)
+  {
+    if (zs_frm[frm].len[0] == 0 && zs_frm[frm].len[1] == 0)
+    {
+      if (ret == 0)
+        MEMPHY_put_freefp(zs_mram, zs_frm[frm].fpn);
+      zs_frm[frm].used = 0;
+      zs_nfrm--;
+    }
+    zs_stat.rej_full++;
+    return -1;
+  }
+
+  zs_frm[frm].len[side] = len;
+  MEMPHY_write_block(zs_mram, zswap_addr(frm, side), (BYTE *)buf, len);
+  zs_tbl[h].frm = frm;
+  zs_tbl[h].side = side;
+  zs_used += len;
+
+  zs_stat.stored++;
+  zs_stat.raw_bytes += PAGING_PAGESZ;
+  zs_stat.comp_bytes += len;
+
+  *handle = h;
+  return ret;
+}
+
+/*
+ * zswap_free - drop a page from the pool
+ * @handle: pool handle
+ *
+ * A frame left empty goes back to MEMRAM.
+ */
+int zswap_free(addr_t handle)
+{
+  struct zswap_frame *f;
+
+  if (handle >= zs_next || zs_tbl[handle].frm < 0)
+    return -1;
+
+  f = &zs_frm[zs_tbl[handle].frm];
+  zs_used -= f->len[zs_tbl[handle].side];
+  f->len[zs_tbl[handle].side] = 0;
+  if (f->len[0] == 0 && f->len[1] == 0)
+  {
+    MEMPHY_put_freefp(zs_mram, f->fpn);
+    f->used = 0;
+    zs_nfrm--;
+  }
+
+  zs_tbl[handle].frm = -1;
+  zs_freeh[zs_nfree++] = handle;
+  return 0;
+}
+
+/*
+ * zswap_load - decompress a page and release its pool entry
+ * @handle: pool handle
+ * @page: PAGING_PAGESZ bytes (out)
+ */
+int zswap_load(addr_t handle, BYTE *page)
+{
+  uint8_t buf[PAGING_PAGESZ];
+  int frm, side, len;
+
+  if (handle >= zs_next || zs_tbl[handle].frm < 0)
+    return -1;
+
+  frm = zs_tbl[handle].frm;
+  side = zs_tbl[handle].side;
+  len = zs_frm[frm].len[side];
+  if (MEMPHY_read_block(zs_mram, zswap_addr(frm, side), (BYTE *)buf, len) != 0 ||
+      lz_decompress(buf, len, (uint8_t *)page, PAGING_PAGESZ) != 0)
+    return -1;
+
+  zs_stat.loaded++;
+  return zswap_free(handle);
+}
+
+/*
+ * zswap_account_dev - count a page moved to (@swapin = 0) or from the
+ * swap device, for the tier hit rates
+ */
+void zswap_account_dev(int swapin)
+{
+  if (swapin)
+    zs_stat.dev_in++;
+  else
+    zs_stat.dev_out++;
+}
+
+/*
+ * zswap_report - print pool usage, compression ratio and tier hit rates
+ */
+void zswap_report(void)
+{
+  uint64_t outs = zs_stat.stored + zs_stat.dev_out;
+  uint64_t ins = zs_stat.loaded + zs_stat.dev_in;
+
+  printf("Compressed swap: pool %d/%d MEMRAM frames, %lu bytes, %lu pages held\n",
+         zs_nfrm, zs_maxfrm, (unsigned long)zs_used,
+         (unsigned long)(zs_next - zs_nfree));
+  printf("  swap-out %llu: %llu to pool, %llu to device "
+         "(%llu pool full, %llu poorly compressed)\n",
+         (unsigned long long)outs, (unsigned long long)zs_stat.stored,
+         (unsigned long long)zs_stat.dev_out,
+         (unsigned long long)zs_stat.rej_full,
+         (unsigned long long)zs_stat.rej_poor);
+  printf("  swap-in  %llu: %llu from pool (%.1f%%), %llu from device\n",
+         (unsigned long long)ins, (unsigned long long)zs_stat.loaded,
+         ins ? 100.0 * zs_stat.loaded / ins : 0.0,
+         (unsigned long long)zs_stat.dev_in);
+  printf("  compression ratio %.2f (%llu -> %llu bytes)\n",
+         zs_stat.comp_bytes ? (double)zs_stat.raw_bytes / zs_stat.comp_bytes : 0.0,
+         (unsigned long long)zs_stat.raw_bytes,
+         (unsigned long long)zs_stat.comp_bytes);
+}
+
+#endif
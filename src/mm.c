@@ -103,9 +103,11 @@ int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff)
 	
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
+  CLRBIT(*pte, PAGING_PTE_ZERO_MASK);
 
   SETVAL(*pte, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
   SETVAL(*pte, swpoff, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
+  __atomic_add_fetch(&krnl->mm->tlb_gen, 1, __ATOMIC_SEQ_CST);
 
   return 0;
 }
@@ -122,12 +124,30 @@ int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
 
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
+  CLRBIT(*pte, PAGING_PTE_ZERO_MASK);
 
   SETVAL(*pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
 
   return 0;
 }
 
+/*
+ * pte_set_zero - Set PTE entry for a page on the shared zero frame
+ * @pgn   : page number
+ * @fpn   : the zero frame (MEMPHY_zero_frame)
+ */
+int pte_set_zero(struct pcb_t *caller, addr_t pgn, addr_t fpn)
+{
+  struct krnl_t *krnl = caller->krnl;
+  addr_t *pte = &krnl->mm->pgd[pgn];
+
+  pte_set_fpn(caller, pgn, fpn);
+  SETBIT(*pte, PAGING_PTE_ZERO_MASK);
+  __atomic_add_fetch(&krnl->mm->tlb_gen, 1, __ATOMIC_SEQ_CST);
+
+  return 0;
+}
+
 
 /* Get PTE page table entry
  * @caller : caller
@@ -153,6 +173,19 @@ int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val)
 	return 0;
 }
 
+/*
+ * pte_clear - Drop the PTE of a page (flat table, nothing to prune)
+ * @caller : caller
+ * @pgn    : page number
+ */
+int pte_clear(struct pcb_t *caller, addr_t pgn)
+{
+	caller->krnl->mm->pgd[pgn] = 0;
+	__atomic_add_fetch(&caller->krnl->mm->tlb_gen, 1, __ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
 /*
  * vmap_pgd_memset - map a range of page at aligned address
  */
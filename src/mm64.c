@@ -117,8 +117,6 @@ int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff)
   addr_t pmd=0;
   addr_t pt=0;
 
-  /* dummy pte alloc to avoid runtime error */
-  pte = malloc(sizeof(addr_t));
 #ifdef MM64
   /* Get value from the system */
   get_pd_from_pagenum(pgn, &pgd, &p4d, &pud, &pmd, &pt);
@@ -157,10 +155,14 @@ int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff)
 
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
+  CLRBIT(*pte, PAGING_PTE_ZERO_MASK);
 
   SETVAL(*pte, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
   SETVAL(*pte, swpoff, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
 
+  /* The frame is about to be reused, drop cached translations */
+  __atomic_add_fetch(&caller->krnl->mm->tlb_gen, 1, __ATOMIC_SEQ_CST);
+
   return 0;
 }
 
@@ -180,8 +182,6 @@ int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
   addr_t pmd=0;
   addr_t pt=0;
 	
-  // dummy pte alloc to avoid runtime error
-  pte = malloc(sizeof(addr_t));
 #ifdef MM64	
   /* Get value from the system */
   /* TODO Perform multi-level page mapping */
@@ -222,12 +222,31 @@ int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
 
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
+  CLRBIT(*pte, PAGING_PTE_ZERO_MASK);
 
   SETVAL(*pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
 
   return 0;
 }
 
+/*
+ * pte_set_zero - Set PTE entry for a page on the shared zero frame
+ * @pgn   : page number
+ * @fpn   : the zero frame (MEMPHY_zero_frame)
+ */
+int pte_set_zero(struct pcb_t *caller, addr_t pgn, addr_t fpn)
+{
+  if (pte_set_fpn(caller, pgn, fpn) != 0)
+    return -1;
+
+  pte_set_entry(caller, pgn, pte_get_entry(caller, pgn) | PAGING_PTE_ZERO_MASK);
+
+  /* A private frame may have been dropped, drop cached translations */
+  __atomic_add_fetch(&caller->krnl->mm->tlb_gen, 1, __ATOMIC_SEQ_CST);
+
+  return 0;
+}
+
 
 /* Get PTE page table entry
  * @caller : caller
@@ -307,6 +326,68 @@ int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val)
 }
 
 
+/* Test whether a page table page has no entry left */
+static int pt_page_empty(uint64_t *table)
+{
+  int i;
+
+  for (i = 0; i < 512; i++)
+    if (table[i])
+      return 0;
+  return 1;
+}
+
+/*
+ * pte_clear - Drop the PTE of a page and release the page table
+ *             pages left empty on the walk back to the PGD
+ * @caller : caller
+ * @pgn    : page number
+ */
+int pte_clear(struct pcb_t *caller, addr_t pgn)
+{
+  if (!caller || !caller->krnl->mm) return -1;
+
+  addr_t pgd=0;
+  addr_t p4d=0;
+  addr_t pud=0;
+  addr_t pmd=0;
+  addr_t pt=0;
+
+  get_pd_from_pagenum(pgn, &pgd, &p4d, &pud, &pmd, &pt);
+  struct mm_struct *mm = caller->krnl->mm;
+
+  uint64_t *p4d_table = (uint64_t *)mm->pgd[pgd];
+  if (!p4d_table) return 0;
+  uint64_t *pud_table = (uint64_t *)p4d_table[p4d];
+  if (!pud_table) return 0;
+  uint64_t *pmd_table = (uint64_t *)pud_table[pud];
+  if (!pmd_table) return 0;
+  uint64_t *pt_table = (uint64_t *)pmd_table[pmd];
+  if (!pt_table) return 0;
+
+  pt_table[pt] = 0;
+  __atomic_add_fetch(&mm->tlb_gen, 1, __ATOMIC_SEQ_CST);
+
+  /* Prune from the leaf up, stop at the first level still in use */
+  if (!pt_page_empty(pt_table)) return 0;
+  free(pt_table);
+  pmd_table[pmd] = 0;
+
+  if (!pt_page_empty(pmd_table)) return 0;
+  free(pmd_table);
+  pud_table[pud] = 0;
+
+  if (!pt_page_empty(pud_table)) return 0;
+  free(pud_table);
+  p4d_table[p4d] = 0;
+
+  if (!pt_page_empty(p4d_table)) return 0;
+  free(p4d_table);
+  mm->pgd[pgd] = 0;
+
+  return 0;
+}
+
 /*
  * vmap_pgd_memset - map a range of page at aligned address
  */
@@ -436,18 +517,33 @@ addr_t vmap_page_range(struct pcb_t *caller,           // process call
          memset((void*)pmd_tbl[pmd_idx], 0, 512 * sizeof(uint64_t));
      }
 
-     // Map Frame vật lý vào bảng phân trang
-     pte_set_fpn(caller, pgn, fpit->fpn);
+     if (PAGING_PAGE_PRESENT(pte_get_entry(caller, pgn)))
+     {
+       /* Trang đã có frame (hoặc đang nằm ở swap): không ghi đè PTE,
+        * trả frame vừa cấp về RAM để không bị rò frame */
+       MEMPHY_put_freefp(caller->krnl->mram, fpit->fpn);
+     }
+     else
+     {
+       // Map Frame vật lý vào bảng phân trang
+       pte_set_fpn(caller, pgn, fpit->fpn);
+       MEMPHY_set_owner(caller->krnl->mram, fpit->fpn, caller->pid);
+       MEMPHY_rmap_set(caller->krnl->mram, fpit->fpn, mm, pgn);
+
+      /* Tracking for later page replacement activities (if needed)
+      * Enqueue new usage page */
+       // Thêm vào danh sách quản lý trang (FIFO) của tiến trình
+       enlist_pgn_node(&mm->fifo_pgn, pgn);
+     }
 
-    /* Tracking for later page replacement activities (if needed)
-    * Enqueue new usage page */
-     // Thêm vào danh sách quản lý trang (FIFO) của tiến trình
-     enlist_pgn_node(&mm->fifo_pgn, pgn);
-     
      // Chuyển sang frame tiếp theo trong danh sách liên kết
      fpit = fpit->fp_next;
   }
 
+  /* Frame chưa được map (thiếu trang) cũng trả lại RAM */
+  for (; fpit != NULL; fpit = fpit->fp_next)
+    MEMPHY_put_freefp(caller->krnl->mram, fpit->fpn);
+
   return 0;
 }
 
@@ -461,20 +557,39 @@ addr_t vmap_page_range(struct pcb_t *caller,           // process call
 addr_t alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struct **frm_lst)
 {
   addr_t fpn;
-  int pgit;
+  int left = req_pgnum, order, i;
   struct framephy_struct *newfp_str = NULL;
+  struct framephy_struct **tail = frm_lst;
 
   if (!caller) return -1;
 
-  for (pgit = 0; pgit < req_pgnum; pgit++)
+  while (*tail != NULL)
+    tail = &(*tail)->fp_next;
+
+  /* Lấy các dãy frame liên tục lớn nhất có thể (buddy), giảm order khi
+   * không còn dãy đủ dài; không ở chế độ buddy thì order 0 từng frame.
+   * Frame được nối theo thứ tự tăng dần để trang liền kề nằm trên frame
+   * liền kề */
+  while (left > 0)
   {
-    if (MEMPHY_get_freefp(caller->krnl->mram, &fpn) == 0)
-    {
-      newfp_str = (struct framephy_struct*)malloc(sizeof(struct framephy_struct));
-      newfp_str->fpn = fpn;
+    order = 0;
+    while (order < MEMPHY_MAX_ORDER && (2 << order) <= left)
+      order++;
+    while (order > 0 && MEMPHY_alloc_order(caller->krnl->mram, order, &fpn) != 0)
+      order--;
 
-      newfp_str->fp_next = *frm_lst;
-      *frm_lst = newfp_str;
+    if (order > 0 || MEMPHY_get_freefp(caller->krnl->mram, &fpn) == 0)
+    {
+      for (i = 0; i < (1 << order); i++)
+      {
+        newfp_str = (struct framephy_struct*)malloc(sizeof(struct framephy_struct));
+        newfp_str->fpn = fpn + i;
+        newfp_str->owner = caller->krnl->mm;
+        newfp_str->fp_next = NULL;
+        *tail = newfp_str;
+        tail = &newfp_str->fp_next;
+      }
+      left -= 1 << order;
     }
     else
     {
@@ -530,6 +645,14 @@ addr_t vm_map_ram(struct pcb_t *caller, addr_t astart, addr_t aend, addr_t mapst
    * do the swaping all to swapper to get the all in ram */
    vmap_page_range(caller, mapstart, incpgnum, frm_lst, ret_rg);
 
+  /* Các node trong danh sách frame chỉ dùng tạm để truyền cho vmap */
+  while (frm_lst != NULL)
+  {
+    struct framephy_struct *fp = frm_lst;
+    frm_lst = fp->fp_next;
+    free(fp);
+  }
+
   return 0;
 }
 
@@ -542,19 +665,8 @@ addr_t vm_map_ram(struct pcb_t *caller, addr_t astart, addr_t aend, addr_t mapst
 int __swap_cp_page(struct memphy_struct *mpsrc, addr_t srcfpn,
                    struct memphy_struct *mpdst, addr_t dstfpn)
 {
-  int cellidx;
-  addr_t addrsrc, addrdst;
-  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
-  {
-    addrsrc = srcfpn * PAGING_PAGESZ + cellidx;
-    addrdst = dstfpn * PAGING_PAGESZ + cellidx;
-
-    BYTE data;
-    MEMPHY_read(mpsrc, addrsrc, &data);
-    MEMPHY_write(mpdst, addrdst, data);
-  }
-
-  return 0;
+  /* Cả trang trong một lần copy thay vì đọc/ghi từng byte */
+  return MEMPHY_copy_page(mpsrc, srcfpn, mpdst, dstfpn);
 }
 
 /*
@@ -589,13 +701,30 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   vma0->vm_start = 0;
   vma0->vm_end = vma0->vm_start;
   vma0->sbrk = vma0->vm_start;
+  vma0->vm_freerg_list = NULL;
   struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
   enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
   vma0->vm_next = NULL;
   vma0->vm_mm = mm;
   mm->mmap = vma0;
-  //Khởi tạo symrgtbl
-  memset(mm->symrgtbl, 0, PAGING_MAX_SYMTBL_SZ * sizeof(struct vm_rg_struct));
+  /* Symbol tables are per process (pcb_t), only the page usage is shared */
+  mm->pgusr = NULL;
+  mm->pgusr_sz = 0;
+  mm->tlb_gen = 0;
+
+#ifdef MM_CODE_PAGING
+  /* Program text lives in its own VMA, grown on demand like vma0 */
+  struct vm_area_struct *vma1 = malloc(sizeof(struct vm_area_struct));
+
+  vma1->vm_id = PAGING_CODE_VMAID;
+  vma1->vm_start = PAGING_CODE_VMA_BASE;
+  vma1->vm_end = vma1->vm_start;
+  vma1->sbrk = vma1->vm_start;
+  vma1->vm_freerg_list = NULL;
+  vma1->vm_next = NULL;
+  vma1->vm_mm = mm;
+  vma0->vm_next = vma1;
+#endif
 
   return 0;
 }
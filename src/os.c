@@ -4,6 +4,9 @@
 #include "sched.h"
 #include "loader.h"
 #include "mm.h"
+#include "prof.h"
+#include "inst.h"
+#include "libmem.h"
 
 #include <pthread.h>
 #include <stdio.h>
@@ -16,8 +19,8 @@ static int done = 0;
 static struct krnl_t os;
 
 #ifdef MM_PAGING
-static int memramsz;
-static int memswpsz[PAGING_MAX_MMSWP];
+static addr_t memramsz;
+static addr_t memswpsz[PAGING_MAX_MMSWP];
 
 struct mmpaging_ld_args {
 	/* A dispatched argument struct to compact many-fields passing to loader */
@@ -30,15 +33,40 @@ struct mmpaging_ld_args {
 };
 #endif
 
-static struct ld_args{
-	char ** path;
-	unsigned long * start_time;
-#ifdef MLQ_SCHED
-	unsigned long * prio;
-#endif
-} ld_processes;
+/* Process list of the configuration, streamed: the file stays open
+ * and arrivals are read one line at a time by the prefetch workers.
+ * num_processes <= 0 in the config header means "until end of file".
+ */
+static FILE * ld_config;
 int num_processes;
 
+/* One arrival of the configuration */
+struct ld_entry {
+	struct pcb_t * proc;	/* Parsed PCB, NULL until a worker loaded it */
+	unsigned long start_time;
+	unsigned long prio;
+	char * path;
+};
+
+/* Prefetch stage of the loader: worker threads read upcoming arrivals
+ * from the config in time order and parse their programs ahead of the
+ * start time into a bounded ring, ld_routine only takes ready PCBs out
+ * of it at admission time. Nothing else of the trace is kept in memory.
+ */
+static struct ld_prefetch {
+	struct ld_entry ring[LD_PREFETCH_WINDOW];
+	int next;	/* Index of the next arrival to be read */
+	int admitted;	/* Number of processes taken by ld_routine */
+	int eof;	/* No arrival after [next] */
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	pthread_cond_t space;
+} ld_prefetch = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.ready = PTHREAD_COND_INITIALIZER,
+	.space = PTHREAD_COND_INITIALIZER,
+};
+
 struct cpu_args {
 	struct timer_id_t * timer_id;
 	int id;
@@ -48,6 +76,9 @@ struct cpu_args {
 static void * cpu_routine(void * args) {
 	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
 	int id = ((struct cpu_args*)args)->id;
+#if defined(MM_PAGING) && defined(MM_NUMA_NODES)
+	MEMPHY_set_node(id % MM_NUMA_NODES);
+#endif
 	/* Check for new process in ready queue */
 	int time_left = 0;
 	struct pcb_t * proc = NULL;
@@ -57,15 +88,17 @@ static void * cpu_routine(void * args) {
 			/* No process is running, the we load new process from
 		 	* ready queue */
 			proc = get_proc();
-			if (proc == NULL) {
-                           next_slot(timer_id);
-                           continue; /* First load failed. skip dummy load */
-                        }
+			/* Nothing to run yet: fall through to the checks below,
+			 * which stop the CPU once the loader is done */
 		}else if (proc->pc == proc->code->size) {
 			/* The porcess has finish it job */
 			printf("\tCPU %d: Processed %2d has finished\n",
 				id ,proc->pid);
-			free(proc);
+			finish_proc(proc);
+#ifdef MM_PAGING
+			free_pcb_memph(proc);
+#endif
+			unload(proc);
 			proc = get_proc();
 			time_left = 0;
 		}else if (time_left == 0) {
@@ -80,6 +113,11 @@ static void * cpu_routine(void * args) {
 		if (proc == NULL && done) {
 			/* No process to run, exit */
 			printf("\tCPU %d stopped\n", id);
+#ifdef MM_CODE_PAGING
+			uint64_t hit, miss;
+			libitlb_stats(&hit, &miss);
+			prof_itlb(id, hit, miss);
+#endif
 			break;
 		}else if (proc == NULL) {
 			/* There may be new processes to run in
@@ -92,15 +130,104 @@ static void * cpu_routine(void * args) {
 			time_left = time_slot;
 		}
 		
-		/* Run current process */
-		run(proc);
-		time_left--;
-		next_slot(timer_id);
+		/* Run current process, a fused CALC may take several slots */
+		int opcode = (proc->pc < proc->code->size) ?
+			(int)INST_OPCODE(proc->code->text[proc->pc]) : -1;
+		int stat;
+		uint64_t t0 = prof_clock();
+		uint32_t used = run_slots(proc, time_left, &stat);
+		prof_account(id, proc->pid, opcode, used, prof_clock() - t0, stat);
+		time_left -= used;
+#ifdef MM_PAGING
+		/* The CPU waits for the sequential devices it accessed */
+		next_slots(timer_id, used + MEMPHY_take_stall());
+#else
+		next_slots(timer_id, used);
+#endif
 	}
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+/* Read the next arrival line of the config into [e].
+ * Return -1 at the end of the process list */
+static int ld_read_entry(struct ld_entry * e) {
+	char * proc = NULL;
+	int n;
+
+	if (num_processes > 0 && ld_prefetch.next >= num_processes)
+		return -1;
+#ifdef MLQ_SCHED
+	n = fscanf(ld_config, "%lu %ms %lu\n", &e->start_time, &proc, &e->prio);
+	if (n != 3) {
+#else
+	e->prio = 0;
+	n = fscanf(ld_config, "%lu %ms\n", &e->start_time, &proc);
+	if (n != 2) {
+#endif
+		free(proc);
+		return -1;
+	}
+	e->path = (char*)malloc(strlen("input/proc/") + strlen(proc) + 1);
+	strcpy(e->path, "input/proc/");
+	strcat(e->path, proc);
+	free(proc);
+	return 0;
+}
+
+static void * ld_prefetch_routine(void * args) {
+	pthread_mutex_lock(&ld_prefetch.lock);
+	while (1) {
+		/* Keep at most LD_PREFETCH_WINDOW arrivals ahead */
+		while (!ld_prefetch.eof &&
+		       ld_prefetch.next - ld_prefetch.admitted >= LD_PREFETCH_WINDOW)
+			pthread_cond_wait(&ld_prefetch.space, &ld_prefetch.lock);
+		if (ld_prefetch.eof)
+			break;
+
+		/* Lines are read under the lock so arrivals keep file order */
+		int i = ld_prefetch.next;
+		struct ld_entry * e = &ld_prefetch.ring[i % LD_PREFETCH_WINDOW];
+		if (ld_read_entry(e) != 0) {
+			ld_prefetch.eof = 1;
+			pthread_cond_broadcast(&ld_prefetch.ready);
+			pthread_cond_broadcast(&ld_prefetch.space);
+			break;
+		}
+		ld_prefetch.next++;
+		pthread_mutex_unlock(&ld_prefetch.lock);
+
+		struct pcb_t * proc = load_image(e->path);
+
+		pthread_mutex_lock(&ld_prefetch.lock);
+		e->proc = proc;
+		pthread_cond_broadcast(&ld_prefetch.ready);
+	}
+	pthread_mutex_unlock(&ld_prefetch.lock);
+	pthread_exit(NULL);
+}
+
+/* Take the prefetched arrival [i], waiting for a worker if needed.
+ * Return -1 when the process list ended before [i] */
+static int ld_prefetch_take(int i, struct ld_entry * e) {
+	struct ld_entry * slot = &ld_prefetch.ring[i % LD_PREFETCH_WINDOW];
+
+	pthread_mutex_lock(&ld_prefetch.lock);
+	while (slot->proc == NULL && !(ld_prefetch.eof && i >= ld_prefetch.next))
+		pthread_cond_wait(&ld_prefetch.ready, &ld_prefetch.lock);
+	if (slot->proc == NULL) {
+		pthread_mutex_unlock(&ld_prefetch.lock);
+		return -1;
+	}
+	*e = *slot;
+	slot->proc = NULL;
+	ld_prefetch.admitted++;
+	pthread_cond_broadcast(&ld_prefetch.space);
+	pthread_mutex_unlock(&ld_prefetch.lock);
+
+	return 0;
+}
+
 static void * ld_routine(void * args) {
 #ifdef MM_PAGING
 	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
@@ -110,32 +237,33 @@ static void * ld_routine(void * args) {
 #else
 	struct timer_id_t * timer_id = (struct timer_id_t*)args;
 #endif
+	struct ld_entry e;
 	int i = 0;
 	printf("ld_routine\n");
-	while (i < num_processes) {
-		struct pcb_t * proc = load(ld_processes.path[i]);
+	while (ld_prefetch_take(i, &e) == 0) {
+		while (current_time() < e.start_time) {
+			next_slot(timer_id);
+		}
+		struct pcb_t * proc = e.proc;
 		struct krnl_t * krnl = proc->krnl = &os;	
 
+		assign_pid(proc);
 #ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
+		proc->prio = e.prio;
 #endif
-		while (current_time() < ld_processes.start_time[i]) {
-			next_slot(timer_id);
-		}
 #ifdef MM_PAGING
 		krnl->mram = mram;
 		krnl->mswp = mswp;
 		krnl->active_mswp = active_mswp;
 #endif
 		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
+			e.path, proc->pid, e.prio);
 		add_proc(proc);
-		free(ld_processes.path[i]);
+		free(e.path);
 		i++;
 		next_slot(timer_id);
 	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
+	fclose(ld_config);
 	done = 1;
 	detach_event(timer_id);
 	pthread_exit(NULL);
@@ -148,9 +276,6 @@ static void read_config(const char * path) {
 		exit(1);
 	}
 	fscanf(file, "%d %d %d\n", &time_slot, &num_cpus, &num_processes);
-	ld_processes.path = (char**)malloc(sizeof(char*) * num_processes);
-	ld_processes.start_time = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
 #ifdef MM_PAGING
 	int sit;
 #ifdef MM_FIXED_MEMSZ
@@ -166,31 +291,16 @@ static void read_config(const char * path) {
 	 * Format: (size=0 result non-used memswap, must have RAM and at least 1 SWAP)
 	 *        MEM_RAM_SZ MEM_SWP0_SZ MEM_SWP1_SZ MEM_SWP2_SZ MEM_SWP3_SZ
 	*/
-	fscanf(file, "%d\n", &memramsz);
+	fscanf(file, SCAN_ADDR "\n", &memramsz);
 	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-		fscanf(file, "%d", &(memswpsz[sit])); 
+		fscanf(file, SCAN_ADDR, &(memswpsz[sit])); 
 
        fscanf(file, "\n"); /* Final character */
 #endif
 #endif
 
-#ifdef MLQ_SCHED
-	ld_processes.prio = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
-#endif
-	int i;
-	for (i = 0; i < num_processes; i++) {
-		ld_processes.path[i] = (char*)malloc(sizeof(char) * 100);
-		ld_processes.path[i][0] = '\0';
-		strcat(ld_processes.path[i], "input/proc/");
-		char proc[100];
-#ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
-#else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
-#endif
-		strcat(ld_processes.path[i], proc);
-	}
+	/* The process list is left in the file, streamed by the loader */
+	ld_config = file;
 }
 
 int main(int argc, char * argv[]) {
@@ -199,16 +309,17 @@ int main(int argc, char * argv[]) {
 		printf("Usage: os [path to configure file]\n");
 		return 1;
 	}
-	char path[100];
-	path[0] = '\0';
-	strcat(path, "input/");
+	char * path = (char*)malloc(strlen("input/") + strlen(argv[1]) + 1);
+	strcpy(path, "input/");
 	strcat(path, argv[1]);
 	read_config(path);
+	free(path);
 
 	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
 	struct cpu_args * args =
 		(struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
 	pthread_t ld;
+	pthread_t ld_workers[LD_PREFETCH_WORKERS];
 	
 	/* Init timer */
 	int i;
@@ -225,21 +336,50 @@ int main(int argc, char * argv[]) {
 
 	struct memphy_struct mram;
 	struct memphy_struct mswp[PAGING_MAX_MMSWP];
+	struct memphy_struct *mswp_tbl[PAGING_MAX_MMSWP];
 
 	/* Create MEM RAM */
-	init_memphy(&mram, memramsz, rdmflag);
+	if (init_memphy(&mram, memramsz, rdmflag) != 0)
+		exit(1);
+#if defined(MEMPHY_BUDDY_RAM) && defined(MM_NUMA_NODES)
+	MEMPHY_numa_init(&mram, MM_NUMA_NODES);
+#elif defined(MEMPHY_BUDDY_RAM)
+	MEMPHY_buddy_init(&mram);
+#endif
+#ifdef MM_ZERO_PAGE
+	MEMPHY_zero_init(&mram);
+#endif
+#ifdef MM_ZSWAP
+	zswap_init(&mram, ZSWAP_POOL_SZ);
+#endif
 
         /* Create all MEM SWAP */ 
 	int sit;
-	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-	       init_memphy(&mswp[sit], memswpsz[sit], rdmflag);
+#ifdef MEMPHY_SWP_SEQ
+	rdmflag = 0;
+#endif
+	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+#ifdef MEMPHY_SWP_FILE
+		char swp_path[64];
+		snprintf(swp_path, sizeof(swp_path), MEMPHY_SWP_FILE, sit);
+		if (init_memphy_file(&mswp[sit], memswpsz[sit], rdmflag, swp_path) != 0)
+			exit(1);
+#else
+		if (init_memphy(&mswp[sit], memswpsz[sit], rdmflag) != 0)
+			exit(1);
+#endif
+		mswp_tbl[sit] = &mswp[sit];
+#ifdef MM_SWAP_CLUSTER_ORDER
+		MEMPHY_buddy_init(&mswp[sit]);
+#endif
+	}
 
 	/* In Paging mode, it needs passing the system mem to each PCB through loader*/
 	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
 
 	mm_ld_args->timer_id = ld_event;
 	mm_ld_args->mram = (struct memphy_struct *) &mram;
-	mm_ld_args->mswp = (struct memphy_struct**) &mswp;
+	mm_ld_args->mswp = mswp_tbl;
 	mm_ld_args->active_mswp = (struct memphy_struct *) &mswp[0];
         mm_ld_args->active_mswp_id = 0;
 
@@ -250,8 +390,12 @@ int main(int argc, char * argv[]) {
 
 	/* Init scheduler */
 	init_scheduler();
+	prof_init(num_cpus);
 
-	/* Run CPU and loader */
+	/* Run loader prefetch workers, CPU and loader */
+	for (i = 0; i < LD_PREFETCH_WORKERS; i++) {
+		pthread_create(&ld_workers[i], NULL, ld_prefetch_routine, NULL);
+	}
 #ifdef MM_PAGING
 	pthread_create(&ld, NULL, ld_routine, (void*)mm_ld_args);
 #else
@@ -267,10 +411,47 @@ int main(int argc, char * argv[]) {
 		pthread_join(cpu[i], NULL);
 	}
 	pthread_join(ld, NULL);
+	for (i = 0; i < LD_PREFETCH_WORKERS; i++) {
+		pthread_join(ld_workers[i], NULL);
+	}
 
 	/* Stop timer */
 	stop_timer();
 
+#ifdef PROF_REPORT
+	/* Report where the simulation time went */
+	prof_report();
+	prof_write_csv(PROF_CSV_PATH);
+#endif
+#if defined(MM_PAGING) && defined(MEMPHY_BUDDY_RAM)
+	MEMPHY_frag_report(&mram, "MEMRAM");
+#endif
+#if defined(MM_PAGING) && defined(MM_NUMA_NODES)
+	MEMPHY_numa_report(&mram, "MEMRAM");
+#endif
+#if defined(MM_PAGING) && defined(MM_ZSWAP)
+	zswap_report();
+#endif
+#ifdef MM_PAGING
+	libswap_report();
+#endif
+#if defined(MM_PAGING) && defined(MEMPHY_SWP_FILE)
+	for (i = 0; i < PAGING_MAX_MMSWP; i++)
+		MEMPHY_sync(&mswp[i]);
+#endif
+#if defined(MM_PAGING) && defined(MEMPHY_SWP_SEQ)
+	for (i = 0; i < PAGING_MAX_MMSWP; i++) {
+		uint64_t seek, xfer;
+		double busy;
+		if (mswp[i].maxsz == 0)
+			continue;
+		MEMPHY_seq_stats(&mswp[i], &seek, &xfer, &busy);
+		printf("MEMSWP%d: seek %llu KB, transfer %llu KB, busy %.1f slots\n",
+		       i, (unsigned long long)(seek >> 10),
+		       (unsigned long long)(xfer >> 10), busy);
+	}
+#endif
+
 	return 0;
 
 }
@@ -0,0 +1,189 @@
+
+#include "prof.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char * prof_opname[PROF_NR_OPCODES] = {
+	"CALC", "ALLOC", "FREE", "READ", "WRITE", "SYSCALL",
+	"MEMSET", "MEMCPY", "MEMCMP",
+};
+
+/* Counters of one CPU: per opcode and per PID (indexed by pid) */
+struct prof_cpu {
+	struct prof_cnt op[PROF_NR_OPCODES];
+	struct prof_cnt * pid;
+	uint32_t npid;
+	uint64_t itlb_hit;
+	uint64_t itlb_miss;
+};
+
+static struct prof_cpu * prof_cpus = NULL;
+static int prof_ncpus = 0;
+
+/* Merged result */
+static struct prof_cnt prof_op[PROF_NR_OPCODES];
+static struct prof_cnt * prof_pid = NULL;
+static uint32_t prof_npid = 0;
+
+void prof_init(int num_cpus) {
+	prof_cpus = (struct prof_cpu *)calloc(num_cpus, sizeof(struct prof_cpu));
+	prof_ncpus = num_cpus;
+}
+
+uint64_t prof_clock(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void prof_add(struct prof_cnt * dst, const struct prof_cnt * src) {
+	dst->count += src->count;
+	dst->ns += src->ns;
+	dst->fail += src->fail;
+}
+
+void prof_account(int cpu, uint32_t pid, int opcode, uint32_t units,
+		uint64_t ns, int fail) {
+	struct prof_cpu * pc;
+
+	if (prof_cpus == NULL || cpu < 0 || cpu >= prof_ncpus ||
+	    opcode < 0 || opcode >= PROF_NR_OPCODES)
+		return;
+
+	pc = &prof_cpus[cpu];
+	pc->op[opcode].count += units;
+	pc->op[opcode].ns += ns;
+	pc->op[opcode].fail += (fail != 0);
+
+	if (pid >= pc->npid) {
+		/* Grow the per PID table geometrically */
+		uint32_t n = pc->npid ? pc->npid : 16;
+		while (n <= pid)
+			n *= 2;
+		pc->pid = (struct prof_cnt *)realloc(pc->pid, n * sizeof(struct prof_cnt));
+		memset(pc->pid + pc->npid, 0, (n - pc->npid) * sizeof(struct prof_cnt));
+		pc->npid = n;
+	}
+	pc->pid[pid].count += units;
+	pc->pid[pid].ns += ns;
+	pc->pid[pid].fail += (fail != 0);
+}
+
+void prof_itlb(int cpu, uint64_t hit, uint64_t miss) {
+	if (prof_cpus == NULL || cpu < 0 || cpu >= prof_ncpus)
+		return;
+	prof_cpus[cpu].itlb_hit = hit;
+	prof_cpus[cpu].itlb_miss = miss;
+}
+
+static void prof_merge(void) {
+	int cpu;
+	uint32_t i;
+
+	memset(prof_op, 0, sizeof(prof_op));
+	prof_npid = 0;
+	for (cpu = 0; cpu < prof_ncpus; cpu++)
+		if (prof_cpus[cpu].npid > prof_npid)
+			prof_npid = prof_cpus[cpu].npid;
+
+	free(prof_pid);
+	prof_pid = (struct prof_cnt *)calloc(prof_npid ? prof_npid : 1,
+			sizeof(struct prof_cnt));
+
+	for (cpu = 0; cpu < prof_ncpus; cpu++) {
+		for (i = 0; i < PROF_NR_OPCODES; i++)
+			prof_add(&prof_op[i], &prof_cpus[cpu].op[i]);
+		for (i = 0; i < prof_cpus[cpu].npid; i++)
+			prof_add(&prof_pid[i], &prof_cpus[cpu].pid[i]);
+	}
+}
+
+void prof_report(void) {
+	struct prof_cnt total = {0, 0, 0};
+	uint32_t i;
+
+	prof_merge();
+	for (i = 0; i < PROF_NR_OPCODES; i++)
+		prof_add(&total, &prof_op[i]);
+	if (total.count == 0)
+		return;
+
+	printf("Profile by opcode:\n");
+	printf("  %-8s %10s %14s %10s %8s %6s\n",
+		"OPCODE", "COUNT", "HOST_NS", "AVG_NS", "FAIL", "TIME%");
+	for (i = 0; i < PROF_NR_OPCODES; i++) {
+		struct prof_cnt * c = &prof_op[i];
+		if (c->count == 0)
+			continue;
+		printf("  %-8s %10llu %14llu %10llu %8llu %5.1f%%\n",
+			prof_opname[i],
+			(unsigned long long)c->count,
+			(unsigned long long)c->ns,
+			(unsigned long long)(c->ns / c->count),
+			(unsigned long long)c->fail,
+			total.ns ? 100.0 * c->ns / total.ns : 0.0);
+	}
+
+	printf("Profile by process:\n");
+	printf("  %-8s %10s %14s %10s %8s\n",
+		"PID", "COUNT", "HOST_NS", "AVG_NS", "FAIL");
+	for (i = 0; i < prof_npid; i++) {
+		struct prof_cnt * c = &prof_pid[i];
+		if (c->count == 0)
+			continue;
+		printf("  %-8u %10llu %14llu %10llu %8llu\n", i,
+			(unsigned long long)c->count,
+			(unsigned long long)c->ns,
+			(unsigned long long)(c->ns / c->count),
+			(unsigned long long)c->fail);
+	}
+
+	/* Only filled when instructions are fetched through the MMU */
+	int cpu, header = 0;
+	for (cpu = 0; cpu < prof_ncpus; cpu++) {
+		struct prof_cpu * pc = &prof_cpus[cpu];
+		uint64_t n = pc->itlb_hit + pc->itlb_miss;
+		if (n == 0)
+			continue;
+		if (!header) {
+			printf("i-TLB by CPU:\n");
+			printf("  %-8s %10s %10s %8s\n", "CPU", "HIT", "MISS", "HIT%");
+			header = 1;
+		}
+		printf("  %-8d %10llu %10llu %7.2f%%\n", cpu,
+			(unsigned long long)pc->itlb_hit,
+			(unsigned long long)pc->itlb_miss,
+			100.0 * pc->itlb_hit / n);
+	}
+}
+
+int prof_write_csv(const char * path) {
+	FILE * file;
+	uint32_t i;
+
+	if ((file = fopen(path, "w")) == NULL) {
+		printf("Cannot write profile to %s\n", path);
+		return -1;
+	}
+
+	prof_merge();
+	fprintf(file, "scope,key,count,host_ns,fail\n");
+	for (i = 0; i < PROF_NR_OPCODES; i++)
+		fprintf(file, "opcode,%s,%llu,%llu,%llu\n", prof_opname[i],
+			(unsigned long long)prof_op[i].count,
+			(unsigned long long)prof_op[i].ns,
+			(unsigned long long)prof_op[i].fail);
+	for (i = 0; i < prof_npid; i++) {
+		if (prof_pid[i].count == 0)
+			continue;
+		fprintf(file, "pid,%u,%llu,%llu,%llu\n", i,
+			(unsigned long long)prof_pid[i].count,
+			(unsigned long long)prof_pid[i].ns,
+			(unsigned long long)prof_pid[i].fail);
+	}
+
+	fclose(file);
+	return 0;
+}
@@ -9,9 +9,18 @@ int empty(struct queue_t * q) {
 
 void enqueue(struct queue_t * q, struct pcb_t * proc) {
         /* TODO: put a new process to queue [q] */
-        if (q->size < MAX_QUEUE_SIZE){
-                q->proc[q->size++] = proc;
+        if (q->size == q->cap) {
+                /* The workload is not bounded, grow instead of dropping */
+                int cap = q->cap ? q->cap * 2 : MAX_QUEUE_SIZE;
+                struct pcb_t ** p = realloc(q->proc, sizeof(*p) * cap);
+                if (p == NULL) {
+                        printf("enqueue: out of memory\n");
+                        exit(1);
+                }
+                q->proc = p;
+                q->cap = cap;
         }
+        q->proc[q->size++] = proc;
 }
 
 struct pcb_t * dequeue(struct queue_t * q) {
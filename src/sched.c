@@ -182,4 +182,37 @@ void add_proc(struct pcb_t * proc) {
 }
 #endif
 
+void finish_proc(struct pcb_t * proc) {
+	/* The process leaves the system: drop it from running_list so the
+	 * list does not fill up with dead PCBs and nobody finds it by PID */
+	pthread_mutex_lock(&queue_lock);
+	purgequeue(&running_list, proc);
+	pthread_mutex_unlock(&queue_lock);
+}
 
+struct pcb_t * find_proc(uint32_t pid) {
+	/* Queues may be reallocated while they grow, so only scan them
+	 * under queue_lock */
+	struct pcb_t * proc = NULL;
+	int i;
+
+	pthread_mutex_lock(&queue_lock);
+	for (i = 0; i < running_list.size && proc == NULL; i++)
+		if (running_list.proc[i]->pid == pid)
+			proc = running_list.proc[i];
+	for (i = 0; i < ready_queue.size && proc == NULL; i++)
+		if (ready_queue.proc[i]->pid == pid)
+			proc = ready_queue.proc[i];
+#ifdef MLQ_SCHED
+	int prio;
+	for (prio = 0; prio < MAX_PRIO && proc == NULL; prio++) {
+		struct queue_t * q = &mlq_ready_queue[prio];
+		for (i = 0; i < q->size && proc == NULL; i++)
+			if (q->proc[i]->pid == pid)
+				proc = q->proc[i];
+	}
+#endif
+	pthread_mutex_unlock(&queue_lock);
+
+	return proc;
+}
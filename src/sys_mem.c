@@ -12,6 +12,7 @@
 #include "syscall.h"
 #include "libmem.h"
 #include "queue.h"
+#include "sched.h"
 #include <stdlib.h>
 
 #ifdef MM64
@@ -35,34 +36,8 @@ int __sys_memmap(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
        return -1;
    }
 
-   /* Search running list */
-   if (krnl->running_list) {
-       for (int i = 0; i < krnl->running_list->size; i++) {
-           struct pcb_t *p = krnl->running_list->proc[i];
-           if (p && p->pid == pid) { caller = p; break; }
-       }
-   }
-
-   /* Search ready queue if not found */
-   if (caller == NULL && krnl->ready_queue) {
-       for (int i = 0; i < krnl->ready_queue->size; i++) {
-           struct pcb_t *p = krnl->ready_queue->proc[i];
-           if (p && p->pid == pid) { caller = p; break; }
-       }
-   }
-
-#ifdef MLQ_SCHED
-   /* Search MLQ ready queues if still not found */
-   if (caller == NULL && krnl->mlq_ready_queue) {
-       for (int pr = 0; pr < MAX_PRIO && caller == NULL; pr++) {
-           struct queue_t *mq = &krnl->mlq_ready_queue[pr];
-           for (int i = 0; i < mq->size; i++) {
-               struct pcb_t *p = mq->proc[i];
-               if (p && p->pid == pid) { caller = p; break; }
-           }
-       }
-   }
-#endif
+   /* Search running list, ready and MLQ queues */
+   caller = find_proc(pid);
 
    if (caller == NULL) {
        /* PID not found in kernel queues; return error */
@@ -47,6 +47,12 @@ static void * timer_routine(void * args) {
 		/* Let devices continue their job */
 		for (temp = dev_list; temp != NULL; temp = temp->next) {
 			pthread_mutex_lock(&temp->id.timer_lock);
+			if (temp->id.skip > 0) {
+				/* Device is still busy in the coming slot */
+				temp->id.skip--;
+				pthread_mutex_unlock(&temp->id.timer_lock);
+				continue;
+			}
 			temp->id.done = 0;
 			pthread_cond_signal(&temp->id.timer_cond);
 			pthread_mutex_unlock(&temp->id.timer_lock);
@@ -59,8 +65,14 @@ static void * timer_routine(void * args) {
 }
 
 void next_slot(struct timer_id_t * timer_id) {
-	/* Tell to timer that we have done our job in current slot */
+	next_slots(timer_id, 1);
+}
+
+void next_slots(struct timer_id_t * timer_id, uint32_t n) {
+	/* Tell to timer that we have done our job in current slot
+	 * and in the n - 1 following slots */
 	pthread_mutex_lock(&timer_id->event_lock);
+	timer_id->skip = (n > 0) ? n - 1 : 0;
 	timer_id->done = 1;
 	pthread_cond_signal(&timer_id->event_cond);
 	pthread_mutex_unlock(&timer_id->event_lock);
@@ -102,6 +114,7 @@ struct timer_id_t * attach_event() {
 			);
 		container->id.done = 0;
 		container->id.fsh = 0;
+		container->id.skip = 0;
 		pthread_cond_init(&container->id.event_cond, NULL);
 		pthread_mutex_init(&container->id.event_lock, NULL);
 		pthread_cond_init(&container->id.timer_cond, NULL);